@@ -3,12 +3,25 @@
 #include <string>
 #include <unordered_map>
 #include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <queue>
+#include <chrono>
+#include <complex>
+#include <cmath>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "../WAVCompressor/FFT.hpp"
 
 class CTrie {
 public:
     CTrie(const std::vector<std::string_view>& samples, const std::vector<int>& startSamplePositions);
     std::vector<int> GetEachEntryInText(const std::string& sample, const std::string& text);
+    std::vector<uint32_t> Compile(const std::string& sample);
     ~CTrie();
 private:
     struct SVertex;
@@ -20,8 +33,17 @@ private:
     SVertex* Transition(SVertex* v, char move);
     SVertex* GetUp(SVertex* v);
     
+    void BuildPrefilter();
+    size_t SkipToCandidate(const std::string& text, size_t from) const;
+    void FlushEntry(size_t i, size_t sampleSize, std::vector<int>& window, std::vector<int>& answer) const;
+    
     SVertex* root;
     
+    // prefilter: a subsample may start only at a first char followed by a pair char
+    std::vector<char> firstChars;
+    std::vector<bool> isFirstChar;
+    std::vector<bool> isPrefixPair;
+    
 };
 
 struct CTrie::SVertex {
@@ -67,6 +89,7 @@ CTrie::CTrie(const std::vector<std::string_view>& samples, const std::vector<int
         root->isTerminal = true;
         root->sampleNums.push_back(0);
     }
+    BuildPrefilter();
 }
 
 CTrie::~CTrie() {
@@ -86,6 +109,53 @@ void CTrie::AddString(const std::string_view& sample, int sampleNum) {
     currentVertex->isTerminal = true;
 }
 
+void CTrie::BuildPrefilter() {
+    isFirstChar.assign(1 << 8, false);
+    isPrefixPair.assign(1 << 16, false);
+    for (const auto& sample : samples) {
+        auto first = static_cast<unsigned char>(sample[0]);
+        if (!isFirstChar[first]) {
+            isFirstChar[first] = true;
+            firstChars.push_back(sample[0]);
+        }
+        if (sample.size() == 1) {
+            for (int second = 0; second < (1 << 8); ++second) {
+                isPrefixPair[(first << 8) | second] = true;
+            }
+        } else {
+            isPrefixPair[(first << 8) | static_cast<unsigned char>(sample[1])] = true;
+        }
+    }
+}
+
+// Returns the first position not less than from at which a subsample can start.
+// Skipping the positions before it from the root leaves the automaton in the root.
+size_t CTrie::SkipToCandidate(const std::string& text, size_t from) const {
+    auto textSize = text.size();
+    while (from < textSize) {
+        if (firstChars.size() == 1) {
+            const void* found = std::memchr(text.data() + from, firstChars[0], textSize - from);
+            if (found == NULL) {
+                return textSize;
+            }
+            from = static_cast<const char*>(found) - text.data();
+        } else {
+            while (from < textSize && !isFirstChar[static_cast<unsigned char>(text[from])]) {
+                ++from;
+            }
+            if (from == textSize) {
+                return textSize;
+            }
+        }
+        if (from + 1 == textSize ||
+            isPrefixPair[(static_cast<unsigned char>(text[from]) << 8) | static_cast<unsigned char>(text[from + 1])]) {
+            return from;
+        }
+        ++from;
+    }
+    return textSize;
+}
+
 CTrie::SVertex* CTrie::SuffLink(SVertex* v) {
     if (v->suffLink == NULL) {
         if (v == root || v->parent == root) {
@@ -123,20 +193,41 @@ CTrie::SVertex* CTrie::GetUp(SVertex *v) {
     return v->up;
 }
 
+// Every subsample of the entry starting at i - sampleSize + 1 ends not later than i,
+// so its counter is final and the slot can be reused.
+void CTrie::FlushEntry(size_t i, size_t sampleSize, std::vector<int>& window, std::vector<int>& answer) const {
+    if (i + 1 >= sampleSize) {
+        int& entries = window[(i - sampleSize + 1) % sampleSize];
+        if (entries == samples.size()) {
+            answer.push_back(i - sampleSize + 1);
+        }
+        entries = 0;
+    }
+}
+
 std::vector<int> CTrie::GetEachEntryInText(const std::string& sample, const std::string& text) {
     auto sampleSize = sample.size();
     auto textSize = text.size();
     
     std::vector<int> answer;
-    std::vector<int> entries (textSize, 0);
+    // entries of window positions [i - sampleSize + 1, i], indexed by position % sampleSize
+    std::vector<int> window (samples.empty() ? 0 : sampleSize, 0);
     
     SVertex* v = root;
     
-    for (auto i = 0; i < textSize; ++i) {
+    for (size_t i = 0; i < textSize; ++i) {
+        if (v == root && !samples.empty()) {
+            size_t candidate = SkipToCandidate(text, i);
+            for (; i < candidate; ++i) {
+                FlushEntry(i, sampleSize, window, answer);
+            }
+            if (i == textSize) {
+                break;
+            }
+        }
         v = Transition(v, text[i]);
         if (v == root && v->isTerminal) {
             if (i + 1 >= sampleSize) {
-                ++entries[i - sampleSize + 1];
                 answer.push_back(i - sampleSize + 1);
             }
         }
@@ -144,29 +235,296 @@ std::vector<int> CTrie::GetEachEntryInText(const std::string& sample, const std:
             if (u->isTerminal) {
                 if (samples.empty()) {
                     if (i + 1 >= sampleSize) {
-                        ++entries[i - sampleSize + 1];
                         answer.push_back(i - sampleSize + 1);
                     }
                 }
                 else {
                     for (auto pos : u->sampleNums) {
                         if (i + 1 >= samples[pos].size() + startSamplePositions[pos]) {
-                            ++entries[i - samples[pos].size() + 1 - startSamplePositions[pos]];
+                            ++window[(i - samples[pos].size() + 1 - startSamplePositions[pos]) % sampleSize];
                         }
                     }
                 }
             }
-        } 
+        }
+        if (!samples.empty()) {
+            FlushEntry(i, sampleSize, window, answer);
+        }
     }
-    if (samples.empty()) {
-        return answer;
+    
+    return answer;
+}
+
+// Image layout, in uint32_t words:
+// header | charClass[256] | transitions[vertexCount * classCount] | up[vertexCount] |
+// outputBegin[vertexCount + 1] | outputs[outputCount] | prefixPairs[1 << 11]
+// All references are vertex ids and offsets, so the image can be mapped at any address.
+struct SAutomatonHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sampleSize;
+    uint32_t sampleCount;
+    uint32_t vertexCount;
+    uint32_t classCount;
+    uint32_t outputCount;
+    uint32_t singleFirstChar;
+    uint32_t wordCount;
+};
+
+const uint32_t automatonMagic = 0x43414843; // "CHAC"
+const uint32_t automatonVersion = 1;
+const uint32_t noSingleFirstChar = 1 << 8;
+const size_t headerWords = sizeof(SAutomatonHeader) / sizeof(uint32_t);
+const size_t prefixPairWords = (1 << 16) / 32;
+
+std::vector<uint32_t> CTrie::Compile(const std::string& sample) {
+    std::vector<SVertex*> vertices;
+    std::unordered_map<SVertex*, uint32_t> ids;
+    std::queue<SVertex*> order;
+    order.push(root);
+    ids[root] = 0;
+    while (!order.empty()) {
+        SVertex* v = order.front();
+        order.pop();
+        vertices.push_back(v);
+        for (const auto& [key, child] : v->children) {
+            uint32_t id = ids.size();
+            ids[child] = id;
+            order.push(child);
+        }
+    }
+    
+    std::vector<uint32_t> charClass(1 << 8, 0);
+    std::vector<char> classChars(1, '\0');
+    for (const auto& subsample : samples) {
+        for (auto c : subsample) {
+            if (charClass[static_cast<unsigned char>(c)] == 0) {
+                charClass[static_cast<unsigned char>(c)] = classChars.size();
+                classChars.push_back(c);
+            }
+        }
     }
     
-    for (auto i = 0; i < textSize; ++i) {
-        if ((textSize - i + 1 > sampleSize) && (entries[i] == samples.size())) {
+    SAutomatonHeader header;
+    header.magic = automatonMagic;
+    header.version = automatonVersion;
+    header.sampleSize = sample.size();
+    header.sampleCount = samples.size();
+    header.vertexCount = vertices.size();
+    header.classCount = classChars.size();
+    header.outputCount = 0;
+    header.singleFirstChar = firstChars.size() == 1 ? static_cast<unsigned char>(firstChars[0]) : noSingleFirstChar;
+    
+    std::vector<uint32_t> transitions;
+    std::vector<uint32_t> up;
+    std::vector<uint32_t> outputBegin;
+    std::vector<uint32_t> outputs;
+    for (auto v : vertices) {
+        // chars of class 0 occur in no subsample and always lead to the root
+        transitions.push_back(0);
+        for (size_t c = 1; c < classChars.size(); ++c) {
+            transitions.push_back(ids[Transition(v, classChars[c])]);
+        }
+        up.push_back(v == root ? 0 : ids[GetUp(v)]);
+        outputBegin.push_back(outputs.size());
+        if (v != root && v->isTerminal) {
+            for (auto pos : v->sampleNums) {
+                outputs.push_back(samples[pos].size() + startSamplePositions[pos]);
+            }
+        }
+    }
+    outputBegin.push_back(outputs.size());
+    header.outputCount = outputs.size();
+    
+    std::vector<uint32_t> image(headerWords);
+    image.insert(image.end(), charClass.begin(), charClass.end());
+    image.insert(image.end(), transitions.begin(), transitions.end());
+    image.insert(image.end(), up.begin(), up.end());
+    image.insert(image.end(), outputBegin.begin(), outputBegin.end());
+    image.insert(image.end(), outputs.begin(), outputs.end());
+    auto prefixPairsBegin = image.size();
+    image.resize(prefixPairsBegin + prefixPairWords, 0);
+    for (size_t pair = 0; pair < isPrefixPair.size(); ++pair) {
+        if (isPrefixPair[pair]) {
+            image[prefixPairsBegin + pair / 32] |= 1u << (pair % 32);
+        }
+    }
+    header.wordCount = image.size();
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+class CCompiledAutomaton {
+public:
+    explicit CCompiledAutomaton(std::vector<uint32_t>&& image);
+    explicit CCompiledAutomaton(const std::string& filename);
+    ~CCompiledAutomaton();
+    
+    void Save(const std::string& filename) const;
+    std::vector<int> GetEachEntryInText(const std::string& text) const;
+    
+private:
+    void Attach(const uint32_t* words, size_t wordCount);
+    size_t SkipToCandidate(const std::string& text, size_t from) const;
+    void FlushEntry(size_t i, std::vector<uint32_t>& window, std::vector<int>& answer) const;
+    
+    std::vector<uint32_t> ownImage;
+    void* mapping;
+    size_t mappingSize;
+    
+    const uint32_t* image;
+    SAutomatonHeader header;
+    const uint32_t* charClass;
+    const uint32_t* transitions;
+    const uint32_t* up;
+    const uint32_t* outputBegin;
+    const uint32_t* outputs;
+    const uint32_t* prefixPairs;
+};
+
+CCompiledAutomaton::CCompiledAutomaton(std::vector<uint32_t>&& image) : ownImage(std::move(image)), mapping(NULL),
+                                                                         mappingSize(0) {
+    Attach(ownImage.data(), ownImage.size());
+}
+
+CCompiledAutomaton::CCompiledAutomaton(const std::string& filename) : mapping(NULL), mappingSize(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0) {
+        std::cerr << "Failed open file";
+        exit(1);
+    }
+    mappingSize = fileStat.st_size;
+    mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed map file";
+        exit(1);
+    }
+    Attach(static_cast<const uint32_t*>(mapping), mappingSize / sizeof(uint32_t));
+}
+
+CCompiledAutomaton::~CCompiledAutomaton() {
+    if (mapping != NULL) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+void CCompiledAutomaton::Attach(const uint32_t* words, size_t wordCount) {
+    image = words;
+    if (wordCount < headerWords) {
+        std::cerr << "Unsupported automaton file";
+        exit(1);
+    }
+    std::memcpy(&header, image, sizeof(header));
+    if (header.magic != automatonMagic || header.version != automatonVersion || header.wordCount != wordCount) {
+        std::cerr << "Unsupported automaton file";
+        exit(1);
+    }
+    // the sections must fill the image exactly, otherwise a damaged header sends reads past its end
+    uint64_t vertexCount = header.vertexCount;
+    uint64_t expectedWords = headerWords + (1 << 8) + vertexCount * header.classCount + vertexCount +
+                             (vertexCount + 1) + header.outputCount + prefixPairWords;
+    if (expectedWords != wordCount || (header.sampleCount > 0 && header.sampleSize == 0)) {
+        std::cerr << "Unsupported automaton file";
+        exit(1);
+    }
+    charClass = image + headerWords;
+    transitions = charClass + (1 << 8);
+    up = transitions + static_cast<size_t>(header.vertexCount) * header.classCount;
+    outputBegin = up + header.vertexCount;
+    outputs = outputBegin + header.vertexCount + 1;
+    prefixPairs = outputs + header.outputCount;
+}
+
+void CCompiledAutomaton::Save(const std::string& filename) const {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed open file";
+        exit(1);
+    }
+    size_t written = fwrite(image, sizeof(uint32_t), header.wordCount, file);
+    if (fclose(file) != 0 || written != header.wordCount) {
+        std::cerr << "Failed write file";
+        exit(1);
+    }
+}
+
+size_t CCompiledAutomaton::SkipToCandidate(const std::string& text, size_t from) const {
+    auto textSize = text.size();
+    while (from < textSize) {
+        if (header.singleFirstChar != noSingleFirstChar) {
+            const void* found = std::memchr(text.data() + from, header.singleFirstChar, textSize - from);
+            if (found == NULL) {
+                return textSize;
+            }
+            from = static_cast<const char*>(found) - text.data();
+        } else {
+            while (from < textSize && transitions[charClass[static_cast<unsigned char>(text[from])]] == 0) {
+                ++from;
+            }
+            if (from == textSize) {
+                return textSize;
+            }
+        }
+        if (from + 1 == textSize) {
+            return from;
+        }
+        uint32_t pair = (static_cast<unsigned char>(text[from]) << 8) | static_cast<unsigned char>(text[from + 1]);
+        if ((prefixPairs[pair / 32] >> (pair % 32)) & 1) {
+            return from;
+        }
+        ++from;
+    }
+    return textSize;
+}
+
+void CCompiledAutomaton::FlushEntry(size_t i, std::vector<uint32_t>& window, std::vector<int>& answer) const {
+    size_t sampleSize = header.sampleSize;
+    if (i + 1 >= sampleSize) {
+        uint32_t& entries = window[(i - sampleSize + 1) % sampleSize];
+        if (entries == header.sampleCount) {
+            answer.push_back(i - sampleSize + 1);
+        }
+        entries = 0;
+    }
+}
+
+std::vector<int> CCompiledAutomaton::GetEachEntryInText(const std::string& text) const {
+    size_t sampleSize = header.sampleSize;
+    auto textSize = text.size();
+    
+    std::vector<int> answer;
+    if (header.sampleCount == 0) {
+        for (size_t i = 0; i + sampleSize <= textSize; ++i) {
             answer.push_back(i);
         }
+        return answer;
+    }
+    
+    std::vector<uint32_t> window(sampleSize, 0);
+    uint32_t v = 0;
+    for (size_t i = 0; i < textSize; ++i) {
+        if (v == 0) {
+            size_t candidate = SkipToCandidate(text, i);
+            for (; i < candidate; ++i) {
+                FlushEntry(i, window, answer);
+            }
+            if (i == textSize) {
+                break;
+            }
+        }
+        v = transitions[static_cast<size_t>(v) * header.classCount + charClass[static_cast<unsigned char>(text[i])]];
+        for (uint32_t u = v; u != 0; u = up[u]) {
+            for (uint32_t output = outputBegin[u]; output < outputBegin[u + 1]; ++output) {
+                if (i + 1 >= outputs[output]) {
+                    ++window[(i + 1 - outputs[output]) % sampleSize];
+                }
+            }
+        }
+        FlushEntry(i, window, answer);
     }
+    
     return answer;
 }
 
@@ -201,17 +559,306 @@ std::vector<std::string_view> ParseSample(std::string& sample, std::vector<int>&
     return parsedSample;
 }
 
-int main() {
+class CShiftAndMatcher {
+public:
+    explicit CShiftAndMatcher(const std::string& sample);
+    std::vector<int> GetEachEntryInText(const std::string& text) const;
+    
+private:
+    size_t sampleSize;
+    size_t wordCount;
+    // masks[c * wordCount + w] has bit j of word w set if sample[64 * w + j] is c or '?'
+    std::vector<uint64_t> masks;
+};
+
+CShiftAndMatcher::CShiftAndMatcher(const std::string& sample) : sampleSize(sample.size()),
+                                                               wordCount((sample.size() + 63) / 64) {
+    masks.assign((1 << 8) * wordCount, 0);
+    for (size_t j = 0; j < sampleSize; ++j) {
+        uint64_t bit = uint64_t(1) << (j % 64);
+        if (sample[j] == '?') {
+            for (int c = 0; c < (1 << 8); ++c) {
+                masks[c * wordCount + j / 64] |= bit;
+            }
+        } else {
+            masks[static_cast<unsigned char>(sample[j]) * wordCount + j / 64] |= bit;
+        }
+    }
+}
+
+std::vector<int> CShiftAndMatcher::GetEachEntryInText(const std::string& text) const {
+    std::vector<int> answer;
+    if (sampleSize == 0) {
+        return answer;
+    }
+    auto textSize = text.size();
+    uint64_t lastBit = uint64_t(1) << ((sampleSize - 1) % 64);
+    
+    // bit j of state is set if sample[0..j] matches the text ending at i;
+    // a bit moves one position per char, so only the words up to the highest nonzero one plus one are live
+    std::vector<uint64_t> state(wordCount, 0);
+    size_t liveWords = 0;
+    for (size_t i = 0; i < textSize; ++i) {
+        const uint64_t* mask = masks.data() + static_cast<unsigned char>(text[i]) * wordCount;
+        liveWords = std::min(liveWords + 1, wordCount);
+        for (size_t w = liveWords - 1; w > 0; --w) {
+            state[w] = ((state[w] << 1) | (state[w - 1] >> 63)) & mask[w];
+        }
+        state[0] = ((state[0] << 1) | 1) & mask[0];
+        
+        if (liveWords == wordCount && (state[wordCount - 1] & lastBit)) {
+            answer.push_back(i - sampleSize + 1);
+        }
+        while (liveWords > 0 && state[liveWords - 1] == 0) {
+            --liveWords;
+        }
+    }
+    
+    return answer;
+}
+
+using cd = std::complex<double>;
+
+// Wildcard matching by convolutions: the entry at s matches iff
+// sum_j p_j * t_{s+j} * (p_j - t_{s+j})^2 = sum p^3 t - 2 p^2 t^2 + p t^3 is zero,
+// where '?' has code 0 both in the sample and in the text.
+class CFFTMatcher {
+public:
+    explicit CFFTMatcher(const std::string& sample);
+    std::vector<int> GetEachEntryInText(const std::string& text, size_t threadsCount) const;
+    
+private:
+    std::vector<int> GetEntriesInBlock(const std::string& text, size_t blockBegin) const;
+    
+    size_t sampleSize;
+    size_t blockSize;
+    std::vector<double> codes;
+    std::vector<cd> roots;
+    // transforms of the first, second and third powers of the reversed sample codes
+    std::vector<std::vector<cd>> sampleTransforms;
+};
+
+CFFTMatcher::CFFTMatcher(const std::string& sample) : sampleSize(sample.size()),
+                                                     blockSize(RoundUpToDegreeOfTwo(std::max<size_t>(4 * sample.size(), 1 << 12))) {
+    // chars absent from the sample share one code, which differs from every sample char
+    codes.assign(1 << 8, 0);
+    double codesNum = 0;
+    for (auto c : sample) {
+        if (c != '?' && codes[static_cast<unsigned char>(c)] == 0) {
+            codes[static_cast<unsigned char>(c)] = ++codesNum;
+        }
+    }
+    ++codesNum;
+    for (int c = 0; c < (1 << 8); ++c) {
+        if (c != '?' && codes[c] == 0) {
+            codes[c] = codesNum;
+        }
+    }
+    
+    roots = MakeRootsOfUnity<double>(blockSize);
+    sampleTransforms.assign(3, std::vector<cd>(blockSize, 0));
+    for (size_t j = 0; j < sampleSize; ++j) {
+        double code = codes[static_cast<unsigned char>(sample[sampleSize - 1 - j])];
+        sampleTransforms[0][j] = code;
+        sampleTransforms[1][j] = code * code;
+        sampleTransforms[2][j] = code * code * code;
+    }
+    for (auto& transform : sampleTransforms) {
+        MakeIterativeFFT(transform, roots, false);
+    }
+}
+
+// The cyclic convolution at s + sampleSize - 1 gets no wrapped terms, so a block of blockSize chars
+// gives the entries starting in its first blockSize - sampleSize + 1 positions.
+std::vector<int> CFFTMatcher::GetEntriesInBlock(const std::string& text, size_t blockBegin) const {
+    std::vector<std::vector<cd>> textTransforms(3, std::vector<cd>(blockSize, 0));
+    for (size_t k = 0; k < blockSize && blockBegin + k < text.size(); ++k) {
+        double code = codes[static_cast<unsigned char>(text[blockBegin + k])];
+        textTransforms[0][k] = code;
+        textTransforms[1][k] = code * code;
+        textTransforms[2][k] = code * code * code;
+    }
+    for (auto& transform : textTransforms) {
+        MakeIterativeFFT(transform, roots, false);
+    }
+    std::vector<cd> sum(blockSize);
+    for (size_t k = 0; k < blockSize; ++k) {
+        sum[k] = sampleTransforms[2][k] * textTransforms[0][k] - 2.0 * sampleTransforms[1][k] * textTransforms[1][k] +
+                 sampleTransforms[0][k] * textTransforms[2][k];
+    }
+    MakeIterativeFFT(sum, roots, true);
+    
+    std::vector<int> answer;
+    for (size_t s = 0; s + sampleSize <= blockSize && blockBegin + s + sampleSize <= text.size(); ++s) {
+        if (std::abs(sum[s + sampleSize - 1].real()) < 0.5) {
+            answer.push_back(blockBegin + s);
+        }
+    }
+    return answer;
+}
+
+std::vector<int> CFFTMatcher::GetEachEntryInText(const std::string& text, size_t threadsCount) const {
+    auto textSize = text.size();
+    if (sampleSize == 0 || textSize < sampleSize) {
+        return std::vector<int>();
+    }
+    
+    // consecutive blocks overlap by sampleSize - 1 chars and are independent
+    size_t blockStep = blockSize - sampleSize + 1;
+    size_t blocksCount = (textSize - sampleSize) / blockStep + 1;
+    std::vector<std::vector<int>> blockAnswers(blocksCount);
+    threadsCount = std::max<size_t>(1, std::min(threadsCount, blocksCount));
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < threadsCount; ++thread) {
+        threads.emplace_back([&, thread]() {
+            for (size_t block = thread; block < blocksCount; block += threadsCount) {
+                blockAnswers[block] = GetEntriesInBlock(text, block * blockStep);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    std::vector<int> answer;
+    for (const auto& blockAnswer : blockAnswers) {
+        answer.insert(answer.end(), blockAnswer.begin(), blockAnswer.end());
+    }
+    return answer;
+}
+
+enum class EMatchEngine {
+    Automaton,
+    ShiftAnd,
+    FFT
+};
+
+const std::vector<std::string> engineNames = {"automaton", "shift-and", "fft"};
+
+// Shift-And does one word operation per char for every 64 sample chars that can still match,
+// which includes all the leading '?' of the sample; the automaton does a hash lookup per char
+// plus one step per occurrence of a subsample, so many short subsamples make it slow.
+// FFT is never chosen by shape: even with all the leading '?' Shift-And stays several times
+// faster, so FFT is left for texts with '?' and for --engine fft.
+EMatchEngine ChooseEngine(const std::string& sample, const std::vector<std::string_view>& parsedSample) {
+    if (parsedSample.empty()) {
+        return EMatchEngine::Automaton;
+    }
+    auto sampleSize = sample.size();
+    size_t leadingWildcards = sample.find_first_not_of('?');
+    size_t fixedChars = 0;
+    for (const auto& subsample : parsedSample) {
+        fixedChars += subsample.size();
+    }
+    bool shortSubsamples = fixedChars < 8 * parsedSample.size();
+    if (leadingWildcards >= 32 * 64) {
+        if (!shortSubsamples || parsedSample.size() < 64) {
+            return EMatchEngine::Automaton;
+        }
+        return EMatchEngine::ShiftAnd;
+    }
+    if (leadingWildcards >= 2 * 64 && !shortSubsamples) {
+        return EMatchEngine::Automaton;
+    }
+    if (sampleSize <= 4 * 64) {
+        return EMatchEngine::ShiftAnd;
+    }
+    return shortSubsamples ? EMatchEngine::ShiftAnd : EMatchEngine::Automaton;
+}
+
+std::vector<int> GetEachEntryInText(EMatchEngine engine, CTrie& trie, const std::string& sample, const std::string& text) {
+    switch (engine) {
+        case EMatchEngine::ShiftAnd:
+            return CShiftAndMatcher(sample).GetEachEntryInText(text);
+        case EMatchEngine::FFT:
+            return CFFTMatcher(sample).GetEachEntryInText(text, std::max(1u, std::thread::hardware_concurrency()));
+        default:
+            return trie.GetEachEntryInText(sample, text);
+    }
+}
+
+// Usage:
+//   main                        reads the sample and the text and prints the entries
+//   main --engine <name>        the same with engine automaton, shift-and or fft instead of the chosen one;
+//                               only fft allows '?' in the text
+//   main --benchmark            reads the sample and the text and reports the time of every engine to stderr
+//   main --save <file>          reads the sample and saves the compiled automaton to file
+//   main --load <file>          maps the compiled automaton from file, reads the text and prints the entries
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    std::string argument = argc > 2 ? argv[2] : "";
     std::string sample;
     std::string text;
+    
+    if (mode == "--load") {
+        CCompiledAutomaton automaton(argument);
+        std::getline(std::cin, text);
+        for (auto pos : automaton.GetEachEntryInText(text)) {
+            std::cout << pos << " ";
+        }
+        return 0;
+    }
+    
     std::getline(std::cin, sample);
-    std::getline(std::cin, text);
     
     std::vector<int> startSamplePositions;
     std::vector<std::string_view> parsedSample = ParseSample(sample, startSamplePositions);
     CTrie trie(parsedSample, startSamplePositions);
-
-    for (auto pos : trie.GetEachEntryInText(sample, text)) {
+    
+    if (mode == "--save") {
+        CCompiledAutomaton(trie.Compile(sample)).Save(argument);
+        return 0;
+    }
+    
+    std::getline(std::cin, text);
+    
+    EMatchEngine chosenEngine = ChooseEngine(sample, parsedSample);
+    bool hasTextWildcards = text.find('?') != std::string::npos;
+    if (hasTextWildcards) {
+        chosenEngine = EMatchEngine::FFT;
+    }
+    
+    if (mode == "--benchmark") {
+        std::vector<int> firstAnswer;
+        std::string fastestEngine;
+        double fastestTime = 0;
+        bool isFirst = true;
+        for (size_t engine = 0; engine < engineNames.size(); ++engine) {
+            // only FFT treats '?' in the text as a wildcard
+            if (hasTextWildcards && static_cast<EMatchEngine>(engine) != EMatchEngine::FFT) {
+                std::cerr << engineNames[engine] << ": skipped, '?' in the text" << std::endl;
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto answer = GetEachEntryInText(static_cast<EMatchEngine>(engine), trie, sample, text);
+            double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << engineNames[engine] << ": " << time << " s" << std::endl;
+            if (isFirst) {
+                firstAnswer = answer;
+            } else if (answer != firstAnswer) {
+                std::cerr << "engines disagree" << std::endl;
+                return 1;
+            }
+            if (isFirst || time < fastestTime) {
+                fastestTime = time;
+                fastestEngine = engineNames[engine];
+            }
+            isFirst = false;
+        }
+        std::cerr << "faster: " << fastestEngine << ", chosen: " << engineNames[static_cast<size_t>(chosenEngine)]
+                  << std::endl;
+        return 0;
+    }
+    
+    if (mode == "--engine") {
+        for (size_t engine = 0; engine < engineNames.size(); ++engine) {
+            if (argument == engineNames[engine]) {
+                chosenEngine = static_cast<EMatchEngine>(engine);
+            }
+        }
+    }
+    
+    for (auto pos : GetEachEntryInText(chosenEngine, trie, sample, text)) {
         std::cout << pos << " ";
     }
     
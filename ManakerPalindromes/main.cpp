@@ -1,54 +1,450 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <thread>
 
-std::vector<long long> CountOddOrEvenPals(const std::string& text, bool isOdd) {
-    auto size = text.size();
-    std::vector<long long> palindromsNum(size);
-    
-    long long evenIndex = isOdd ? 0 : 1;
-    long long left = 0;
-    long long right = -1;
-    
-    for (int i = 0; i < size; ++i) {
-        long long lengthOfPalWithCenterInI = 0;
-        
-        if (i <= right) {
-            lengthOfPalWithCenterInI = std::min(right - i + evenIndex, palindromsNum[right - i + left + evenIndex]);
+// Manacher in one pass over the virtual string of 2n - 1 positions: even ones are the chars,
+// odd ones the gaps between them, so odd and even palindromes are found together and no
+// separated copy of the text is built. lengths[k] is the length in chars of the longest
+// palindrome centered at position k (odd for chars, even, maybe 0, for gaps).
+// This one fills lengths[k] for k in [centerBegin, centerEnd) with the palindromes of the
+// suffix of text from the char centerBegin (even), so they are cut at its left border but may
+// go beyond centerEnd: O(centerEnd - centerBegin + how far they go).
+template <typename TIndex>
+void CalculatePalindromeLengths(std::string_view text, size_t centerBegin, size_t centerEnd,
+                                std::vector<TIndex>& lengths) {
+    size_t virtualSize = 2 * text.size() - 1;
+    // [left, right] is the rightmost palindrome found, both ends are chars
+    size_t left = centerBegin;
+    size_t right = centerBegin;
+    for (size_t k = centerBegin; k < centerEnd; ++k) {
+        TIndex length = k % 2 == 0 ? 1 : 0;
+        if (k < right) {
+            // the mirror center has the same parity, so the length keeps it
+            length = std::min<size_t>(lengths[left + right - k], right - k + 1);
         }
-        
-        while ((i + lengthOfPalWithCenterInI + 1 - evenIndex < size) && (i - lengthOfPalWithCenterInI - 1 >= 0) &&
-            (text[i + lengthOfPalWithCenterInI + 1 - evenIndex] == text[i - lengthOfPalWithCenterInI - 1])) {
-                ++lengthOfPalWithCenterInI;
-            }
-        
-        palindromsNum[i] = lengthOfPalWithCenterInI;
-        
-        if (i + lengthOfPalWithCenterInI - evenIndex > right) {
-            left = i - lengthOfPalWithCenterInI;
-            right = i + lengthOfPalWithCenterInI - evenIndex;
+        while (length + 1 <= k - centerBegin && k + length + 1 < virtualSize &&
+               text[(k - length - 1) / 2] == text[(k + length + 1) / 2]) {
+            length += 2;
+        }
+        lengths[k] = length;
+        if (length > 0 && k + length - 1 > right) {
+            left = k - length + 1;
+            right = k + length - 1;
         }
     }
-    return palindromsNum;
 }
 
+// TIndex = uint32_t takes 8 bytes per char, uint64_t is needed beyond 4e9 chars.
+template <typename TIndex = uint32_t>
+std::vector<TIndex> CalculatePalindromeLengths(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    std::vector<TIndex> lengths(2 * text.size() - 1);
+    CalculatePalindromeLengths(text, 0, lengths.size(), lengths);
+    return lengths;
+}
+
+template <typename TIndex = uint32_t>
 long long CountPalindroms(const std::string& text) {
-    auto size = text.size();
+    long long numberOfPalindroms = 0;
+    // a center with the longest palindrome of length l has l / 2 of length at least 2
+    for (auto length : CalculatePalindromeLengths<TIndex>(text)) {
+        numberOfPalindroms += length / 2;
+    }
+    return numberOfPalindroms;
+}
+
+// CountPalindroms on threadsCount threads, in the same memory. Each thread runs Manacher on the
+// suffix of the text from its block for the centers of the block, so the palindromes are exact
+// except those cut at the left border of the block. Then one Manacher pass goes over the centers
+// of each block up to its last cut one, block after block, starting from the rightmost
+// palindrome of all the centers before: the mirror centers are exact by then, so this pass is
+// O(n) in all, and a run of one char costs about its length rather than a search per center.
+template <typename TIndex = uint32_t>
+long long CountPalindromsParallel(const std::string& text, size_t threadsCount) {
+    size_t size = text.size();
+    if (size == 0) {
+        return 0;
+    }
+    threadsCount = std::max<size_t>(1, std::min(threadsCount, size / 4096 + 1));
+    size_t blockSize = (size + threadsCount - 1) / threadsCount;
+    size_t virtualSize = 2 * size - 1;
+    std::vector<TIndex> lengths(virtualSize);
     
-    std::vector<long long> oddPalindromsNum = CountOddOrEvenPals(text, true);
-    std::vector<long long> evenPalindromsNum = CountOddOrEvenPals(text, false);
+    struct SBlock {
+        // centers of the block, the gap after it included
+        size_t centerBegin = 0;
+        size_t centerEnd = 0;
+        // centers in [centerBegin, cutEnd) may be cut at the left border
+        size_t cutEnd = 0;
+        // palindromes of the centers from cutEnd on
+        long long count = 0;
+        // the one of them that reaches farthest, as its ends
+        size_t left = 0;
+        size_t right = 0;
+    };
+    std::vector<SBlock> blocks(threadsCount);
+    auto countBlock = [&](size_t index) {
+        SBlock& block = blocks[index];
+        block.centerBegin = std::min(virtualSize, 2 * index * blockSize);
+        block.centerEnd = std::min(virtualSize, 2 * (index + 1) * blockSize);
+        CalculatePalindromeLengths(text, block.centerBegin, block.centerEnd, lengths);
+        block.cutEnd = block.centerBegin;
+        for (size_t k = block.centerBegin; index > 0 && k < block.centerEnd; ++k) {
+            if (k < block.centerBegin + lengths[k] + 1 && k + lengths[k] + 1 < virtualSize) {
+                block.cutEnd = k + 1;
+            }
+        }
+        block.left = block.right = block.centerBegin;
+        for (size_t k = block.cutEnd; k < block.centerEnd; ++k) {
+            block.count += lengths[k] / 2;
+            if (lengths[k] > 0 && k + lengths[k] - 1 > block.right) {
+                block.left = k - lengths[k] + 1;
+                block.right = k + lengths[k] - 1;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t block = 1; block < threadsCount; ++block) {
+        threads.emplace_back(countBlock, block);
+    }
+    countBlock(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
     
     long long numberOfPalindroms = 0;
-    for (int i = 0; i < size; ++i) {
-        numberOfPalindroms += oddPalindromsNum[i] + evenPalindromsNum[i];
+    size_t left = 0;
+    size_t right = 0;
+    for (const auto& block : blocks) {
+        for (size_t k = block.centerBegin; k < block.cutEnd; ++k) {
+            // the cut length is a lower bound, as is the mirror one
+            TIndex length = lengths[k];
+            if (k < right) {
+                length = std::max<size_t>(length, std::min<size_t>(lengths[left + right - k], right - k + 1));
+            }
+            while (length + 1 <= k && k + length + 1 < virtualSize &&
+                   text[(k - length - 1) / 2] == text[(k + length + 1) / 2]) {
+                length += 2;
+            }
+            lengths[k] = length;
+            numberOfPalindroms += length / 2;
+            if (length > 0 && k + length - 1 > right) {
+                left = k - length + 1;
+                right = k + length - 1;
+            }
+        }
+        numberOfPalindroms += block.count;
+        if (block.right > right) {
+            left = block.left;
+            right = block.right;
+        }
     }
-    
     return numberOfPalindroms;
 }
 
-int main() {
+// Range maximum over a static array with the index of the maximum, O(1) per query on
+// [left, right] after O(n log n) preprocessing.
+template <typename T>
+class CSparseTable {
+public:
+    explicit CSparseTable(const std::vector<T>& values);
+    
+    size_t GetMaxIndex(size_t left, size_t right) const;
+    
+private:
+    std::vector<T> values;
+    // maxIndices[level][i]: index of the maximum of values[i .. i + 2^level - 1]
+    std::vector<std::vector<uint32_t>> maxIndices;
+    std::vector<int> levels;
+};
+
+template <typename T>
+CSparseTable<T>::CSparseTable(const std::vector<T>& values) : values(values) {
+    auto size = values.size();
+    levels.assign(size + 1, 0);
+    for (size_t length = 2; length <= size; ++length) {
+        levels[length] = levels[length / 2] + 1;
+    }
+    maxIndices.emplace_back(size);
+    for (size_t i = 0; i < size; ++i) {
+        maxIndices[0][i] = i;
+    }
+    for (int level = 1; (size_t(1) << level) <= size; ++level) {
+        const auto& previous = maxIndices[level - 1];
+        std::vector<uint32_t> current(size - (size_t(1) << level) + 1);
+        for (size_t i = 0; i < current.size(); ++i) {
+            uint32_t left = previous[i];
+            uint32_t right = previous[i + (size_t(1) << (level - 1))];
+            current[i] = values[right] > values[left] ? right : left;
+        }
+        maxIndices.push_back(std::move(current));
+    }
+}
+
+template <typename T>
+size_t CSparseTable<T>::GetMaxIndex(size_t left, size_t right) const {
+    int level = levels[right - left + 1];
+    size_t first = maxIndices[level][left];
+    size_t second = maxIndices[level][right + 1 - (size_t(1) << level)];
+    return values[second] > values[first] ? second : first;
+}
+
+// Palindrome queries on substrings from the Manacher lengths: s[left .. right] is a palindrome
+// iff the center left + right has a palindrome at least that long, O(1); the longest palindrome
+// inside [left, right] is found by a binary search over range maximums, O(log n).
+// Positions are 0-based, ranges inclusive. The sparse table limits the text to 2^31 chars.
+template <typename TIndex = uint32_t>
+class CPalindromeIndex {
+public:
+    explicit CPalindromeIndex(const std::string& text);
+    
+    // left <= right < text size, the queries below answer false and (left, 0) otherwise
+    bool IsValidRange(size_t left, size_t right) const;
+    bool IsPalindrome(size_t left, size_t right) const;
+    // start and length of a longest palindrome in s[left .. right]
+    std::pair<size_t, size_t> FindLongestPalindrome(size_t left, size_t right) const;
+    
+private:
+    // the longest palindrome centered in [centerLeft, centerRight] and not beyond border on the
+    // side away from the middle, as (center, length)
+    std::pair<size_t, size_t> FindLongestInHalf(size_t centerLeft, size_t centerRight, bool isLeftHalf) const;
+    
+    size_t size;
+    std::vector<TIndex> lengths;
+    CSparseTable<TIndex> maxLengths;
+};
+
+template <typename TIndex>
+CPalindromeIndex<TIndex>::CPalindromeIndex(const std::string& text) :
+        size(text.size()), lengths(CalculatePalindromeLengths<TIndex>(text)), maxLengths(lengths) {
+}
+
+template <typename TIndex>
+bool CPalindromeIndex<TIndex>::IsValidRange(size_t left, size_t right) const {
+    return left <= right && right < size;
+}
+
+template <typename TIndex>
+bool CPalindromeIndex<TIndex>::IsPalindrome(size_t left, size_t right) const {
+    return IsValidRange(left, right) && lengths[left + right] >= right - left + 1;
+}
+
+template <typename TIndex>
+std::pair<size_t, size_t> CPalindromeIndex<TIndex>::FindLongestInHalf(size_t centerLeft, size_t centerRight,
+                                                                      bool isLeftHalf) const {
+    // in the left half a center k fits a palindrome of length at most k - centerLeft + 1, in the
+    // right one centerRight - k + 1; a length x fits iff some center far enough from the border
+    // has lengths at least x, which is monotone in x
+    auto fits = [&](size_t x) {
+        if (x > centerRight - centerLeft + 1) {
+            return false;
+        }
+        size_t from = isLeftHalf ? centerLeft + x - 1 : centerLeft;
+        size_t to = isLeftHalf ? centerRight : centerRight + 1 - x;
+        return lengths[maxLengths.GetMaxIndex(from, to)] >= x;
+    };
+    size_t low = 1;
+    size_t high = centerRight - centerLeft + 2;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (fits(middle)) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    size_t from = isLeftHalf ? centerLeft + low - 1 : centerLeft;
+    size_t to = isLeftHalf ? centerRight : centerRight + 1 - low;
+    return {maxLengths.GetMaxIndex(from, to), low};
+}
+
+template <typename TIndex>
+std::pair<size_t, size_t> CPalindromeIndex<TIndex>::FindLongestPalindrome(size_t left, size_t right) const {
+    if (!IsValidRange(left, right)) {
+        return {left, 0};
+    }
+    // the range is [2 left, 2 right] in the virtual string, a single char always fits
+    size_t middle = left + right;
+    auto leftBest = FindLongestInHalf(2 * left, middle, true);
+    auto rightBest = FindLongestInHalf(middle, 2 * right, false);
+    auto best = rightBest.second > leftBest.second ? rightBest : leftBest;
+    return {(best.first + 1 - best.second) / 2, best.second};
+}
+
+// Palindromic tree (eertree), append-only: one node per distinct palindrome, O(1) amortized
+// per char for a fixed alphabet. Node 0 is the root of length -1, node 1 the empty palindrome.
+// Transitions are flat per-node edge lists, as in the suffix automaton.
+class CPalindromicTree {
+public:
+    CPalindromicTree();
+    
+    void Append(char c);
+    
+    // distinct non-empty palindromes, single chars included
+    size_t CountDistinctPalindromes() const;
+    // occurrences of palindromes of length at least 2 in the text so far, as CountPalindroms
+    unsigned long long CountPalindromes() const;
+    size_t GetLongestPalindromicSuffix() const;
+    
+private:
+    int FindEdge(int node, char c) const;
+    // the longest palindromic suffix of node, which extends by the char at position
+    int FindExtendable(int node, size_t position) const;
+    
+    std::string text;
+    std::vector<int> lengths;
+    std::vector<int> links;
+    // number of palindromic suffixes of the node palindrome, itself included
+    std::vector<int> depths;
+    std::vector<int> firstEdges;
+    
+    std::vector<char> edgeChars;
+    std::vector<int> edgeTargets;
+    std::vector<int> nextEdges;
+    
+    int last;
+    unsigned long long palindromesCount;
+};
+
+CPalindromicTree::CPalindromicTree() : lengths{-1, 0}, links{0, 0}, depths{0, 0}, firstEdges{-1, -1}, last(1),
+                                       palindromesCount(0) {
+}
+
+int CPalindromicTree::FindEdge(int node, char c) const {
+    int edge = firstEdges[node];
+    while (edge != -1 && edgeChars[edge] != c) {
+        edge = nextEdges[edge];
+    }
+    return edge == -1 ? -1 : edgeTargets[edge];
+}
+
+int CPalindromicTree::FindExtendable(int node, size_t position) const {
+    while (true) {
+        long long before = static_cast<long long>(position) - lengths[node] - 1;
+        if (before >= 0 && text[before] == text[position]) {
+            return node;
+        }
+        node = links[node];
+    }
+}
+
+void CPalindromicTree::Append(char c) {
+    size_t position = text.size();
+    text.push_back(c);
+    int parent = FindExtendable(last, position);
+    int node = FindEdge(parent, c);
+    if (node == -1) {
+        node = lengths.size();
+        lengths.push_back(lengths[parent] + 2);
+        // a single char links to the empty palindrome
+        int link = lengths[node] == 1 ? 1 : FindEdge(FindExtendable(links[parent], position), c);
+        links.push_back(link);
+        depths.push_back(depths[link] + 1);
+        firstEdges.push_back(-1);
+        edgeChars.push_back(c);
+        edgeTargets.push_back(node);
+        nextEdges.push_back(firstEdges[parent]);
+        firstEdges[parent] = edgeChars.size() - 1;
+    }
+    last = node;
+    // every palindromic suffix but the single char has length at least 2
+    palindromesCount += depths[node] - 1;
+}
+
+size_t CPalindromicTree::CountDistinctPalindromes() const {
+    return lengths.size() - 2;
+}
+
+unsigned long long CPalindromicTree::CountPalindromes() const {
+    return palindromesCount;
+}
+
+size_t CPalindromicTree::GetLongestPalindromicSuffix() const {
+    return lengths[last];
+}
+
+// Per prefix counts of palindromes of length at least 2 by the tree and by Manacher rerun on
+// every prefix, for the first up to 20000 chars of text; the timings go to stderr.
+int RunBenchmark(const std::string& text) {
+    std::string prefix = text.substr(0, 20000);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned long long> byTree;
+    CPalindromicTree tree;
+    for (auto c : prefix) {
+        tree.Append(c);
+        byTree.push_back(tree.CountPalindromes());
+    }
+    auto middle = std::chrono::steady_clock::now();
+    std::vector<unsigned long long> byManacher;
+    for (size_t length = 1; length <= prefix.size(); ++length) {
+        byManacher.push_back(CountPalindroms(prefix.substr(0, length)));
+    }
+    auto finish = std::chrono::steady_clock::now();
+    std::cerr << prefix.size() << " prefixes, palindromic tree: " << std::chrono::duration<double>(middle - start).count()
+              << " s, Manacher on each prefix: " << std::chrono::duration<double>(finish - middle).count() << " s"
+              << std::endl;
+    if (byTree != byManacher) {
+        std::cerr << "counts differ" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Usage:
+//   main                  reads the text and prints the number of its palindromes of length at least 2
+//   main --prefixes       for each prefix prints that number, the number of distinct palindromes
+//                         and the length of the longest palindromic suffix
+//   main --benchmark      reads the text and compares per prefix counting with Manacher
+//   main --threads <n>    counts the palindromes of length at least 2 on n threads
+//   main --queries        reads the text, then lines "l r" (0-based, inclusive) and prints for each
+//                         whether s[l .. r] is a palindrome, the start and the length of the longest
+//                         palindrome inside it, or "Invalid range" unless l <= r < text size
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    
+    if (mode == "--prefixes") {
+        CPalindromicTree tree;
+        for (int c = std::cin.get(); c != EOF && c != '\n'; c = std::cin.get()) {
+            tree.Append(c);
+            std::cout << tree.CountPalindromes() << ' ' << tree.CountDistinctPalindromes() << ' '
+                      << tree.GetLongestPalindromicSuffix() << '\n';
+        }
+        return 0;
+    }
+    
     std::string text;
     std::getline(std::cin, text);
+    
+    if (mode == "--benchmark") {
+        return RunBenchmark(text);
+    }
+    
+    if (mode == "--threads" && argc > 2) {
+        std::cout << CountPalindromsParallel(text, std::stoul(argv[2])) << std::endl;
+        return 0;
+    }
+    
+    if (mode == "--queries") {
+        CPalindromeIndex<> index(text);
+        size_t left, right;
+        while (std::cin >> left >> right) {
+            if (!index.IsValidRange(left, right)) {
+                std::cout << "Invalid range\n";
+                continue;
+            }
+            auto longest = index.FindLongestPalindrome(left, right);
+            std::cout << index.IsPalindrome(left, right) << ' ' << longest.first << ' ' << longest.second << '\n';
+        }
+        return 0;
+    }
+    
     std::cout << CountPalindroms(text) << std::endl;
     return 0;
 }
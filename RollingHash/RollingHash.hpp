@@ -0,0 +1,182 @@
+//
+//  RollingHash.hpp
+//  RollingHash
+//
+//  Polynomial prefix hashes modulo 2^61 - 1, shared by the string tools.
+//
+
+#ifndef RollingHash_hpp
+#define RollingHash_hpp
+
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// Prefix hashes of a text (or of its reverse): O(1) hash of any substring, so substring
+// equality in O(1) and the longest common prefix of two positions in O(log n), up to collisions
+// of probability about n / 2^61 per comparison. Texts compared with each other must share the base.
+// Takes 16 bytes per char: the hashes and the powers of the base.
+class CRollingHash {
+public:
+    static const uint64_t modulo = (uint64_t(1) << 61) - 1;
+    
+    // a base fixed at the first call, random per run
+    static uint64_t GetDefaultBase();
+    
+    // isReversed hashes the text read from its end; threadsCount > 1 builds in parallel
+    explicit CRollingHash(std::string_view text, bool isReversed = false, size_t threadsCount = 1,
+                          uint64_t base = GetDefaultBase());
+    
+    size_t GetSize() const;
+    uint64_t GetBase() const;
+    // hash of the length chars from begin, begin + length must not exceed the size
+    uint64_t GetHash(size_t begin, size_t length) const;
+    // hash of a separate string with the same base, comparable with GetHash
+    uint64_t Hash(std::string_view text) const;
+    // length of the longest common prefix of the suffixes first of this text and second of other,
+    // positions must not exceed the sizes
+    size_t GetCommonPrefix(size_t first, const CRollingHash& other, size_t second) const;
+    size_t GetCommonPrefix(size_t first, size_t second) const;
+    
+    static uint64_t Multiply(uint64_t first, uint64_t second);
+    static uint64_t Add(uint64_t first, uint64_t second);
+    
+private:
+    void BuildPowers();
+    void BuildHashes(std::string_view text, bool isReversed, size_t threadsCount);
+    
+    uint64_t base;
+    std::vector<uint64_t> powers;
+    std::vector<uint64_t> hashes;
+};
+
+inline uint64_t CRollingHash::Multiply(uint64_t first, uint64_t second) {
+    unsigned __int128 product = static_cast<unsigned __int128>(first) * second;
+    uint64_t result = (static_cast<uint64_t>(product) & modulo) + static_cast<uint64_t>(product >> 61);
+    return result >= modulo ? result - modulo : result;
+}
+
+inline uint64_t CRollingHash::Add(uint64_t first, uint64_t second) {
+    uint64_t result = first + second;
+    return result >= modulo ? result - modulo : result;
+}
+
+inline uint64_t CRollingHash::GetDefaultBase() {
+    static const uint64_t base = std::chrono::steady_clock::now().time_since_epoch().count() % (modulo - 1024) + 512;
+    return base;
+}
+
+inline CRollingHash::CRollingHash(std::string_view text, bool isReversed, size_t threadsCount, uint64_t base) :
+        base(base), powers(text.size() + 1), hashes(text.size() + 1, 0) {
+    BuildPowers();
+    BuildHashes(text, isReversed, std::max<size_t>(1, threadsCount));
+}
+
+inline void CRollingHash::BuildPowers() {
+    // four independent chains by base^4, not one by base, to overlap the multiplications
+    const size_t chainsCount = 4;
+    powers[0] = 1;
+    for (size_t i = 1; i < powers.size() && i <= chainsCount; ++i) {
+        powers[i] = Multiply(powers[i - 1], base);
+    }
+    uint64_t step = chainsCount < powers.size() ? powers[chainsCount] : 0;
+    for (size_t i = chainsCount + 1; i < powers.size(); ++i) {
+        powers[i] = Multiply(powers[i - chainsCount], step);
+    }
+}
+
+inline void CRollingHash::BuildHashes(std::string_view text, bool isReversed, size_t threadsCount) {
+    // The chain h[i + 1] = h[i] * base + c is bound by the multiplication latency. The text is
+    // split into blocks hashed from zero, each thread advancing lanesCount blocks at once so that
+    // their multiplications overlap; then each block is shifted by the hash of all before it.
+    const size_t lanesCount = 4;
+    size_t size = text.size();
+    size_t blocksCount = threadsCount * lanesCount;
+    size_t blockSize = std::max<size_t>(1, (size + blocksCount - 1) / blocksCount);
+    auto charAt = [&](size_t i) -> uint64_t {
+        return static_cast<unsigned char>(isReversed ? text[size - 1 - i] : text[i]) + 1;
+    };
+    auto forEachThread = [&](auto function) {
+        std::vector<std::thread> threads;
+        for (size_t thread = 1; thread < threadsCount; ++thread) {
+            threads.emplace_back(function, thread);
+        }
+        function(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+    
+    forEachThread([&](size_t thread) {
+        size_t firstBlock = thread * lanesCount;
+        uint64_t lanes[lanesCount] = {0, 0, 0, 0};
+        for (size_t offset = 0; offset < blockSize; ++offset) {
+            for (size_t lane = 0; lane < lanesCount; ++lane) {
+                size_t i = (firstBlock + lane) * blockSize + offset;
+                if (i < size) {
+                    lanes[lane] = Add(Multiply(lanes[lane], base), charAt(i));
+                    hashes[i + 1] = lanes[lane];
+                }
+            }
+        }
+    });
+    
+    std::vector<uint64_t> shifts(blocksCount, 0);
+    for (size_t block = 1; block < blocksCount && (block - 1) * blockSize < size; ++block) {
+        size_t end = std::min(size, block * blockSize);
+        shifts[block] = Add(Multiply(shifts[block - 1], powers[end - (block - 1) * blockSize]), hashes[end]);
+    }
+    
+    forEachThread([&](size_t thread) {
+        for (size_t block = thread * lanesCount + 1; block < (thread + 1) * lanesCount + 1 && block < blocksCount; ++block) {
+            size_t begin = block * blockSize;
+            size_t end = std::min(size, begin + blockSize);
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i + 1] = Add(Multiply(shifts[block], powers[i + 1 - begin]), hashes[i + 1]);
+            }
+        }
+    });
+}
+
+inline size_t CRollingHash::GetSize() const {
+    return hashes.size() - 1;
+}
+
+inline uint64_t CRollingHash::GetBase() const {
+    return base;
+}
+
+inline uint64_t CRollingHash::GetHash(size_t begin, size_t length) const {
+    return Add(hashes[begin + length], modulo - Multiply(hashes[begin], powers[length]));
+}
+
+inline uint64_t CRollingHash::Hash(std::string_view text) const {
+    uint64_t hash = 0;
+    for (auto c : text) {
+        hash = Add(Multiply(hash, base), static_cast<unsigned char>(c) + 1);
+    }
+    return hash;
+}
+
+inline size_t CRollingHash::GetCommonPrefix(size_t first, const CRollingHash& other, size_t second) const {
+    size_t low = 0;
+    size_t high = std::min(GetSize() - first, other.GetSize() - second) + 1;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (GetHash(first, middle) == other.GetHash(second, middle)) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+inline size_t CRollingHash::GetCommonPrefix(size_t first, size_t second) const {
+    return GetCommonPrefix(first, *this, second);
+}
+
+#endif /* RollingHash_hpp */
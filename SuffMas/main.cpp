@@ -2,154 +2,2201 @@
 #include <vector>
 #include <iostream>
 #include <unordered_map>
+#include <queue>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "../RollingHash/RollingHash.hpp"
+
+inline long long ToSymbol(char c) {
+    return static_cast<unsigned char>(c);
+}
+
+template <typename TSymbol>
+inline long long ToSymbol(TSymbol c) {
+    return c;
+}
+
+// SA-IS: sorts the suffixes of text with symbols in [0, upper] in O(n + upper).
+// TIndex is a signed integer wide enough for text.size().
+template <typename TIndex, typename TSequence>
+std::vector<TIndex> BuildSuffixArraySais(const TSequence& text, TIndex upper) {
+    TIndex size = text.size();
+    if (size == 0) {
+        return std::vector<TIndex>();
+    }
+    if (size == 1) {
+        return std::vector<TIndex>(1, 0);
+    }
+    auto symbol = [&text](TIndex i) {
+        return static_cast<TIndex>(ToSymbol(text[i]));
+    };
+    
+    // isSType[i]: suffix i is smaller than suffix i + 1
+    std::vector<bool> isSType(size, false);
+    for (TIndex i = size - 2; i >= 0; --i) {
+        isSType[i] = symbol(i) == symbol(i + 1) ? isSType[i + 1] : symbol(i) < symbol(i + 1);
+    }
+    
+    // bucket of symbol c: L-type suffixes start at lBegin[c], S-type suffixes start at sBegin[c]
+    std::vector<TIndex> lBegin(upper + 2, 0);
+    std::vector<TIndex> sBegin(upper + 2, 0);
+    for (TIndex i = 0; i < size; ++i) {
+        if (!isSType[i]) {
+            ++sBegin[symbol(i)];
+        } else {
+            ++lBegin[symbol(i) + 1];
+        }
+    }
+    for (TIndex c = 0; c <= upper; ++c) {
+        sBegin[c] += lBegin[c];
+        lBegin[c + 1] += sBegin[c];
+    }
+    
+    std::vector<TIndex> suffixArray(size);
+    std::vector<TIndex> bucket(upper + 2);
+    auto induce = [&](const std::vector<TIndex>& lmsSuffixes) {
+        std::fill(suffixArray.begin(), suffixArray.end(), -1);
+        std::copy(sBegin.begin(), sBegin.end(), bucket.begin());
+        for (auto suffix : lmsSuffixes) {
+            suffixArray[bucket[symbol(suffix)]++] = suffix;
+        }
+        std::copy(lBegin.begin(), lBegin.end(), bucket.begin());
+        suffixArray[bucket[symbol(size - 1)]++] = size - 1;
+        for (TIndex i = 0; i < size; ++i) {
+            TIndex suffix = suffixArray[i];
+            if (suffix >= 1 && !isSType[suffix - 1]) {
+                suffixArray[bucket[symbol(suffix - 1)]++] = suffix - 1;
+            }
+        }
+        std::copy(lBegin.begin(), lBegin.end(), bucket.begin());
+        for (TIndex i = size - 1; i >= 0; --i) {
+            TIndex suffix = suffixArray[i];
+            if (suffix >= 1 && isSType[suffix - 1]) {
+                suffixArray[--bucket[symbol(suffix - 1) + 1]] = suffix - 1;
+            }
+        }
+    };
+    
+    std::vector<TIndex> lmsNumbers(size + 1, -1);
+    std::vector<TIndex> lmsSuffixes;
+    for (TIndex i = 1; i < size; ++i) {
+        if (!isSType[i - 1] && isSType[i]) {
+            lmsNumbers[i] = lmsSuffixes.size();
+            lmsSuffixes.push_back(i);
+        }
+    }
+    TIndex lmsCount = lmsSuffixes.size();
+    
+    induce(lmsSuffixes);
+    if (lmsCount == 0) {
+        return suffixArray;
+    }
+    
+    // name LMS substrings in sorted order and sort the reduced string recursively
+    std::vector<TIndex> sortedLms;
+    sortedLms.reserve(lmsCount);
+    for (auto suffix : suffixArray) {
+        if (lmsNumbers[suffix] != -1) {
+            sortedLms.push_back(suffix);
+        }
+    }
+    std::vector<TIndex> reducedText(lmsCount);
+    TIndex reducedUpper = 0;
+    reducedText[lmsNumbers[sortedLms[0]]] = 0;
+    for (TIndex i = 1; i < lmsCount; ++i) {
+        TIndex left = sortedLms[i - 1];
+        TIndex right = sortedLms[i];
+        TIndex leftEnd = lmsNumbers[left] + 1 < lmsCount ? lmsSuffixes[lmsNumbers[left] + 1] : size;
+        TIndex rightEnd = lmsNumbers[right] + 1 < lmsCount ? lmsSuffixes[lmsNumbers[right] + 1] : size;
+        bool isSame = leftEnd - left == rightEnd - right;
+        if (isSame) {
+            while (left < leftEnd && symbol(left) == symbol(right)) {
+                ++left;
+                ++right;
+            }
+            isSame = left != size && symbol(left) == symbol(right);
+        }
+        if (!isSame) {
+            ++reducedUpper;
+        }
+        reducedText[lmsNumbers[sortedLms[i]]] = reducedUpper;
+    }
+    std::vector<TIndex> reducedSuffixArray = BuildSuffixArraySais<TIndex>(reducedText, reducedUpper);
+    
+    for (TIndex i = 0; i < lmsCount; ++i) {
+        sortedLms[i] = lmsSuffixes[reducedSuffixArray[i]];
+    }
+    induce(sortedLms);
+    return suffixArray;
+}
+
+// Φ algorithm (Kärkkäinen, Manzini, Puglisi): plcp[p] is the lcp of the suffix p and the one
+// following it in the suffix array, -1 for the last suffix. Unlike Kasai, text positions are
+// visited in order, so the comparisons read the text sequentially; the only random accesses
+// are in the two passes over the suffix array. The Φ array is overwritten by the result.
+template <typename TIndex, typename TSequence>
+std::vector<TIndex> BuildPermutedLcpArray(const TSequence& text, const std::vector<TIndex>& suffixArray) {
+    TIndex size = text.size();
+    std::vector<TIndex> plcp(size);
+    for (TIndex i = 0; i + 1 < size; ++i) {
+        plcp[suffixArray[i]] = suffixArray[i + 1];
+    }
+    if (size > 0) {
+        plcp[suffixArray[size - 1]] = -1;
+    }
+    TIndex k = 0;
+    for (TIndex i = 0; i < size; ++i) {
+        TIndex j = plcp[i];
+        if (j == -1) {
+            k = 0;
+            continue;
+        }
+        while (std::max(i + k, j + k) < size && text[i + k] == text[j + k]) {
+            ++k;
+        }
+        plcp[i] = k;
+        if (k > 0) {
+            --k;
+        }
+    }
+    return plcp;
+}
+
+// lcp[i] is the lcp of suffixes suffixArray[i] and suffixArray[i + 1], lcp[size - 1] = -1.
+template <typename TIndex, typename TSequence>
+std::vector<TIndex> BuildLcpArray(const TSequence& text, const std::vector<TIndex>& suffixArray) {
+    std::vector<TIndex> plcp = BuildPermutedLcpArray(text, suffixArray);
+    std::vector<TIndex> lcp(suffixArray.size());
+    for (size_t i = 0; i < suffixArray.size(); ++i) {
+        lcp[i] = plcp[suffixArray[i]];
+    }
+    return lcp;
+}
+
+// LCP array in one byte per value: values from 0 to 254 are stored as is, others (long
+// repeats and the final -1) are escaped by 255 and kept in a sorted overflow table.
+template <typename TIndex>
+class CCompressedLcp {
+public:
+    template <typename TSequence>
+    CCompressedLcp(const TSequence& text, const std::vector<TIndex>& suffixArray);
+    
+    TIndex operator[](size_t i) const;
+    size_t GetSize() const;
+    size_t GetSizeInBytes() const;
+    
+private:
+    static const uint8_t escape = 255;
+    
+    std::vector<uint8_t> values;
+    std::vector<std::pair<size_t, TIndex>> overflows;
+};
+
+template <typename TIndex>
+template <typename TSequence>
+CCompressedLcp<TIndex>::CCompressedLcp(const TSequence& text, const std::vector<TIndex>& suffixArray) :
+        values(suffixArray.size()) {
+    std::vector<TIndex> plcp = BuildPermutedLcpArray(text, suffixArray);
+    for (size_t i = 0; i < suffixArray.size(); ++i) {
+        TIndex value = plcp[suffixArray[i]];
+        if (value >= 0 && value < escape) {
+            values[i] = value;
+        } else {
+            values[i] = escape;
+            overflows.emplace_back(i, value);
+        }
+    }
+}
+
+template <typename TIndex>
+TIndex CCompressedLcp<TIndex>::operator[](size_t i) const {
+    if (values[i] != escape) {
+        return values[i];
+    }
+    return std::lower_bound(overflows.begin(), overflows.end(), std::make_pair(i, std::numeric_limits<TIndex>::min()))->second;
+}
+
+template <typename TIndex>
+size_t CCompressedLcp<TIndex>::GetSize() const {
+    return values.size();
+}
+
+template <typename TIndex>
+size_t CCompressedLcp<TIndex>::GetSizeInBytes() const {
+    return values.size() + overflows.size() * sizeof(overflows[0]);
+}
+
+// Splits [0, size) into threadsCount contiguous parts and calls function(begin, end, part) on each in its own thread.
+template <typename TFunction>
+void ParallelFor(size_t size, size_t threadsCount, TFunction function) {
+    threadsCount = std::max<size_t>(1, std::min(threadsCount, size));
+    if (threadsCount == 1) {
+        function(0, size, 0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t part = 0; part < threadsCount; ++part) {
+        threads.emplace_back(function, size * part / threadsCount, size * (part + 1) / threadsCount, part);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Stable LSD radix sort of items by key(item) < 2^keyBits into items, using buffer of the same size.
+// Every pass counts the digits of each thread's chunk, turns the counts into per thread offsets
+// (digit major, then thread) and scatters the chunks independently, keeping their order.
+template <typename TItem, typename TKey>
+void ParallelRadixSort(std::vector<TItem>& items, std::vector<TItem>& buffer, size_t keyBits,
+                       size_t threadsCount, TKey key) {
+    const size_t maxDigitBits = 11;
+    size_t size = items.size();
+    threadsCount = std::max<size_t>(1, std::min(threadsCount, size));
+    size_t passesCount = (keyBits + maxDigitBits - 1) / maxDigitBits;
+    size_t digitBits = passesCount == 0 ? 0 : (keyBits + passesCount - 1) / passesCount;
+    size_t digitsCount = size_t(1) << digitBits;
+    std::vector<size_t> offsets(threadsCount * digitsCount);
+    for (size_t pass = 0; pass < passesCount; ++pass) {
+        size_t shift = pass * digitBits;
+        std::fill(offsets.begin(), offsets.end(), 0);
+        ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+            size_t* counts = offsets.data() + part * digitsCount;
+            for (size_t i = begin; i < end; ++i) {
+                ++counts[(key(items[i]) >> shift) & (digitsCount - 1)];
+            }
+        });
+        size_t total = 0;
+        for (size_t digit = 0; digit < digitsCount; ++digit) {
+            for (size_t part = 0; part < threadsCount; ++part) {
+                size_t count = offsets[part * digitsCount + digit];
+                offsets[part * digitsCount + digit] = total;
+                total += count;
+            }
+        }
+        ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+            size_t* next = offsets.data() + part * digitsCount;
+            for (size_t i = begin; i < end; ++i) {
+                buffer[next[(key(items[i]) >> shift) & (digitsCount - 1)]++] = items[i];
+            }
+        });
+        items.swap(buffer);
+    }
+}
+
+// Prefix doubling: every round sorts suffixes by the ranks of their first h and next h chars
+// and ranks each suffix by the start of its group, until all groups are single suffixes.
+// The order by the second rank comes for free from the previous round: suffix p - h follows
+// the order of p there. So each round is one parallel radix sort by the first rank, O(n) work,
+// O(n log n) in total against O(n) for SA-IS.
+template <typename TIndex>
+std::vector<TIndex> BuildSuffixArrayParallel(const std::string& text, size_t threadsCount) {
+    struct SRankPair {
+        TIndex rank;
+        TIndex nextRank;
+        TIndex position;
+    };
+    size_t size = text.size();
+    size_t rankBits = 0;
+    while ((size_t(1) << rankBits) < std::max<size_t>(size, 1 << 8)) {
+        ++rankBits;
+    }
+    std::vector<TIndex> ranks(size);
+    std::vector<SRankPair> items(size);
+    std::vector<SRankPair> buffer(size);
+    ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            ranks[i] = static_cast<unsigned char>(text[i]);
+            items[i] = {ranks[i], i + 1 < size ? static_cast<unsigned char>(text[i + 1]) : -1, static_cast<TIndex>(i)};
+        }
+    });
+    // the first round has no previous order, it sorts by both chars
+    ParallelRadixSort(items, buffer, 9, threadsCount, [](const SRankPair& item) {
+        return static_cast<size_t>(item.nextRank + 1);
+    });
+    
+    std::vector<TIndex> lastGroupStarts(threadsCount);
+    std::vector<TIndex> groupsCounts(threadsCount);
+    std::vector<size_t> shiftedCounts(threadsCount);
+    for (size_t height = 1; size > 0; height *= 2) {
+        if (height > 1) {
+            // suffixes running past the end have no second rank and go first, then the order of p - h
+            // is the order of p in the previous round
+            size_t tailSize = std::min(height, size);
+            std::fill(shiftedCounts.begin(), shiftedCounts.end(), 0);
+            ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+                for (size_t i = begin; i < end; ++i) {
+                    shiftedCounts[part] += static_cast<size_t>(items[i].position) >= height;
+                }
+            });
+            std::vector<size_t> firstOutputs(threadsCount);
+            size_t output = tailSize;
+            for (size_t part = 0; part < threadsCount; ++part) {
+                firstOutputs[part] = output;
+                output += shiftedCounts[part];
+            }
+            ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+                for (size_t i = begin; i < std::min(end, tailSize); ++i) {
+                    TIndex position = size - tailSize + i;
+                    buffer[i] = {ranks[position], -1, position};
+                }
+                size_t current = firstOutputs[part];
+                for (size_t i = begin; i < end; ++i) {
+                    size_t next = items[i].position;
+                    if (next >= height) {
+                        TIndex position = next - height;
+                        buffer[current++] = {ranks[position], ranks[next], position};
+                    }
+                }
+            });
+            items.swap(buffer);
+        }
+        ParallelRadixSort(items, buffer, rankBits, threadsCount, [](const SRankPair& item) {
+            return static_cast<size_t>(item.rank);
+        });
+        
+        auto isGroupStart = [&items](size_t i) {
+            return i == 0 || items[i].rank != items[i - 1].rank || items[i].nextRank != items[i - 1].nextRank;
+        };
+        std::fill(lastGroupStarts.begin(), lastGroupStarts.end(), -1);
+        std::fill(groupsCounts.begin(), groupsCounts.end(), 0);
+        ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+            for (size_t i = begin; i < end; ++i) {
+                if (isGroupStart(i)) {
+                    lastGroupStarts[part] = i;
+                    ++groupsCounts[part];
+                }
+            }
+        });
+        size_t groupsCount = 0;
+        TIndex groupStart = 0;
+        std::vector<TIndex> firstGroupStarts(threadsCount);
+        for (size_t part = 0; part < threadsCount; ++part) {
+            firstGroupStarts[part] = groupStart;
+            groupStart = lastGroupStarts[part] == -1 ? groupStart : lastGroupStarts[part];
+            groupsCount += groupsCounts[part];
+        }
+        ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t part) {
+            TIndex currentGroupStart = firstGroupStarts[part];
+            for (size_t i = begin; i < end; ++i) {
+                if (isGroupStart(i)) {
+                    currentGroupStart = i;
+                }
+                ranks[items[i].position] = currentGroupStart;
+            }
+        });
+        if (groupsCount == size || height >= size) {
+            break;
+        }
+    }
+    
+    std::vector<TIndex> suffixArray(size);
+    ParallelFor(size, threadsCount, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            suffixArray[i] = items[i].position;
+        }
+    });
+    return suffixArray;
+}
+
+template <typename TIndex = int>
 class CSuffixArray {
 public:
-    explicit CSuffixArray(const std::string&);
-    ~CSuffixArray() = default;
+    // threadsCount >= 4 builds long texts by parallel prefix doubling instead of sequential SA-IS:
+    // on one thread the doubling does about twice the work of SA-IS, so fewer threads do not pay off
+    explicit CSuffixArray(const std::string&, size_t threadsCount = 1);
+    ~CSuffixArray() = default;
+    
+    std::vector<TIndex> GetSuffixArray() const;
+    std::vector<TIndex> BuildLcp() const;
+    // the same values in about one byte each, without the full lcp array at any moment
+    CCompressedLcp<TIndex> BuildCompressedLcp() const;
+    const std::string& GetText() const;
+    
+    // n (n + 1) / 2 may not fit into 64 bits for n above 6e9, TCount = unsigned __int128 then
+    template <typename TCount = unsigned long long>
+    TCount CountUniqueSubstrings() const;
+    
+    // Pattern queries by binary search over the suffix array with LCP-LR acceleration,
+    // O(|pattern| + log n) each; the LCP-LR arrays are built by the first query.
+    TIndex Count(const std::string& pattern);
+    std::vector<TIndex> Locate(const std::string& pattern);
+    std::vector<TIndex> CountBatch(const std::vector<std::string>& patterns, size_t threadsCount = 1);
+    
+private:
+    void BuildQueryIndex();
+    TIndex BuildLcpLr(const std::vector<TIndex>& lcp, TIndex left, TIndex right);
+    TIndex MatchLength(TIndex suffix, const std::string& pattern, TIndex from) const;
+    bool IsBefore(TIndex suffix, const std::string& pattern, TIndex matchLength, bool isUpper) const;
+    TIndex FindBound(const std::string& pattern, bool isUpper) const;
+    
+    std::vector<TIndex> suffixArray;
+    std::string text;
+    // for every midpoint M of the binary search between L and R: lcp of suffixes L and M, of M and R
+    std::vector<TIndex> lcpLeft;
+    std::vector<TIndex> lcpRight;
+    static const TIndex alphabetLen;
+    static const size_t parallelMinimalSize;
+    static const size_t parallelMinimalThreads;
+};
+
+template <typename TIndex>
+const TIndex CSuffixArray<TIndex>::alphabetLen = 256;
+
+template <typename TIndex>
+const size_t CSuffixArray<TIndex>::parallelMinimalSize = 1 << 16;
+
+template <typename TIndex>
+const size_t CSuffixArray<TIndex>::parallelMinimalThreads = 4;
+
+template <typename TIndex>
+CSuffixArray<TIndex>::CSuffixArray(const std::string& text, size_t threadsCount) : text(text) {
+    if (threadsCount >= parallelMinimalThreads && this->text.size() >= parallelMinimalSize) {
+        suffixArray = BuildSuffixArrayParallel<TIndex>(this->text, threadsCount);
+    } else {
+        suffixArray = BuildSuffixArraySais<TIndex>(this->text, alphabetLen - 1);
+    }
+}
+
+template <typename TIndex>
+std::vector<TIndex> CSuffixArray<TIndex>::BuildLcp() const{
+    return BuildLcpArray(text, suffixArray);
+}
+
+template <typename TIndex>
+CCompressedLcp<TIndex> CSuffixArray<TIndex>::BuildCompressedLcp() const {
+    return CCompressedLcp<TIndex>(text, suffixArray);
+}
+
+template <typename TIndex>
+std::vector<TIndex> CSuffixArray<TIndex>::GetSuffixArray() const{
+    return suffixArray;
+}
+
+template <typename TIndex>
+const std::string& CSuffixArray<TIndex>::GetText() const{
+    return text;
+}
+
+template <typename TIndex>
+void CSuffixArray<TIndex>::BuildQueryIndex() {
+    TIndex size = suffixArray.size();
+    lcpLeft.assign(size, 0);
+    lcpRight.assign(size, 0);
+    if (size > 1) {
+        BuildLcpLr(BuildLcp(), 0, size - 1);
+    }
+}
+
+// Returns the lcp of suffixes left and right of the suffix array, filling the midpoints between them.
+template <typename TIndex>
+TIndex CSuffixArray<TIndex>::BuildLcpLr(const std::vector<TIndex>& lcp, TIndex left, TIndex right) {
+    if (right - left == 1) {
+        return lcp[left];
+    }
+    TIndex middle = left + (right - left) / 2;
+    lcpLeft[middle] = BuildLcpLr(lcp, left, middle);
+    lcpRight[middle] = BuildLcpLr(lcp, middle, right);
+    return std::min(lcpLeft[middle], lcpRight[middle]);
+}
+
+template <typename TIndex>
+TIndex CSuffixArray<TIndex>::MatchLength(TIndex suffix, const std::string& pattern, TIndex from) const {
+    TIndex size = text.size();
+    TIndex patternSize = pattern.size();
+    while (from < patternSize && suffix + from < size && text[suffix + from] == pattern[from]) {
+        ++from;
+    }
+    return from;
+}
+
+// Whether the suffix goes before the bound: below the pattern, or also starting with it for the upper bound.
+template <typename TIndex>
+bool CSuffixArray<TIndex>::IsBefore(TIndex suffix, const std::string& pattern, TIndex matchLength,
+                                    bool isUpper) const {
+    if (matchLength == static_cast<TIndex>(pattern.size())) {
+        return isUpper;
+    }
+    if (suffix + matchLength == static_cast<TIndex>(text.size())) {
+        return true;
+    }
+    return static_cast<unsigned char>(text[suffix + matchLength]) <
+           static_cast<unsigned char>(pattern[matchLength]);
+}
+
+// Index of the first suffix not before the bound. Keeps suffix L before and suffix R not before,
+// with l and r their lcp with the pattern; a midpoint sharing more than max(l, r) chars with the
+// closer end lies on the same side, one sharing less lies on the other, only ties compare chars.
+template <typename TIndex>
+TIndex CSuffixArray<TIndex>::FindBound(const std::string& pattern, bool isUpper) const {
+    TIndex size = suffixArray.size();
+    if (size == 0) {
+        return 0;
+    }
+    TIndex left = 0;
+    TIndex right = size - 1;
+    TIndex leftMatch = MatchLength(suffixArray[left], pattern, 0);
+    if (!IsBefore(suffixArray[left], pattern, leftMatch, isUpper)) {
+        return 0;
+    }
+    TIndex rightMatch = MatchLength(suffixArray[right], pattern, 0);
+    if (IsBefore(suffixArray[right], pattern, rightMatch, isUpper)) {
+        return size;
+    }
+    while (right - left > 1) {
+        TIndex middle = left + (right - left) / 2;
+        TIndex middleMatch;
+        if (leftMatch >= rightMatch) {
+            if (lcpLeft[middle] > leftMatch) {
+                left = middle;
+                continue;
+            }
+            if (lcpLeft[middle] < leftMatch) {
+                right = middle;
+                rightMatch = lcpLeft[middle];
+                continue;
+            }
+            middleMatch = MatchLength(suffixArray[middle], pattern, leftMatch);
+        } else {
+            if (lcpRight[middle] > rightMatch) {
+                right = middle;
+                continue;
+            }
+            if (lcpRight[middle] < rightMatch) {
+                left = middle;
+                leftMatch = lcpRight[middle];
+                continue;
+            }
+            middleMatch = MatchLength(suffixArray[middle], pattern, rightMatch);
+        }
+        if (IsBefore(suffixArray[middle], pattern, middleMatch, isUpper)) {
+            left = middle;
+            leftMatch = middleMatch;
+        } else {
+            right = middle;
+            rightMatch = middleMatch;
+        }
+    }
+    return right;
+}
+
+template <typename TIndex>
+TIndex CSuffixArray<TIndex>::Count(const std::string& pattern) {
+    if (lcpLeft.size() != suffixArray.size()) {
+        BuildQueryIndex();
+    }
+    return FindBound(pattern, true) - FindBound(pattern, false);
+}
+
+// Positions of the occurrences, in suffix array order.
+template <typename TIndex>
+std::vector<TIndex> CSuffixArray<TIndex>::Locate(const std::string& pattern) {
+    if (lcpLeft.size() != suffixArray.size()) {
+        BuildQueryIndex();
+    }
+    return std::vector<TIndex>(suffixArray.begin() + FindBound(pattern, false),
+                               suffixArray.begin() + FindBound(pattern, true));
+}
+
+// Patterns are answered in lexicographic order, so neighbouring queries walk the same
+// part of the suffix array, and the sorted order is split between threads.
+template <typename TIndex>
+std::vector<TIndex> CSuffixArray<TIndex>::CountBatch(const std::vector<std::string>& patterns,
+                                                     size_t threadsCount) {
+    if (lcpLeft.size() != suffixArray.size()) {
+        BuildQueryIndex();
+    }
+    std::vector<size_t> order(patterns.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&patterns](size_t left, size_t right) {
+        return patterns[left] < patterns[right];
+    });
+    std::vector<TIndex> counts(patterns.size());
+    ParallelFor(order.size(), threadsCount, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const std::string& pattern = patterns[order[i]];
+            counts[order[i]] = FindBound(pattern, true) - FindBound(pattern, false);
+        }
+    });
+    return counts;
+}
+
+template <typename TIndex>
+template <typename TCount>
+TCount CSuffixArray<TIndex>::CountUniqueSubstrings() const {
+    std::vector<TIndex> lcp = BuildLcp();
+    auto size = text.size();
+    TCount answer = 0;
+    for (auto element : suffixArray) {
+        answer += size - element;
+    }
+    for (size_t i = 0; i + 1 < size; ++i) {
+        answer -= lcp[i];
+    }
+    return answer;
+}
+
+// Suffix automaton built online: after each appended char the number of distinct substrings
+// of the prefix read so far is known, amortized O(1) per char for a fixed alphabet.
+// Transitions are kept in flat arrays as per-state singly linked edge lists, new edges are
+// prepended, so a state costs no allocation and small alphabets are scanned in a few steps.
+class CSuffixAutomaton {
+public:
+    CSuffixAutomaton();
+    
+    void Append(char c);
+    unsigned long long CountUniqueSubstrings() const;
+    // number of occurrences of pattern in the text appended so far
+    size_t CountOccurrences(const std::string& pattern);
+    // start in other and length of the longest common substring of the text and other
+    std::pair<size_t, size_t> FindLongestCommonSubstring(const std::string& other) const;
+    
+private:
+    int GetNext(int state, char c) const;
+    int FindEdge(int state, char c) const;
+    void AddEdge(int state, char c, int target);
+    void CountEndPositions();
+    
+    // length of the longest string of the state
+    std::vector<size_t> lengths;
+    std::vector<int> links;
+    std::vector<int> firstEdges;
+    // number of ends of the occurrences, valid while isCountValid
+    std::vector<size_t> endCounts;
+    std::vector<bool> isClone;
+    
+    std::vector<char> edgeChars;
+    std::vector<int> edgeTargets;
+    std::vector<int> nextEdges;
+    
+    int last;
+    unsigned long long uniqueSubstrings;
+    bool isCountValid;
+};
+
+CSuffixAutomaton::CSuffixAutomaton() : lengths(1, 0), links(1, -1), firstEdges(1, -1), isClone(1, false), last(0),
+                                       uniqueSubstrings(0), isCountValid(false) {
+}
+
+int CSuffixAutomaton::FindEdge(int state, char c) const {
+    int edge = firstEdges[state];
+    while (edge != -1 && edgeChars[edge] != c) {
+        edge = nextEdges[edge];
+    }
+    return edge;
+}
+
+int CSuffixAutomaton::GetNext(int state, char c) const {
+    int edge = FindEdge(state, c);
+    return edge == -1 ? -1 : edgeTargets[edge];
+}
+
+void CSuffixAutomaton::AddEdge(int state, char c, int target) {
+    edgeChars.push_back(c);
+    edgeTargets.push_back(target);
+    nextEdges.push_back(firstEdges[state]);
+    firstEdges[state] = edgeChars.size() - 1;
+}
+
+void CSuffixAutomaton::Append(char c) {
+    isCountValid = false;
+    int current = lengths.size();
+    lengths.push_back(lengths[last] + 1);
+    links.push_back(0);
+    firstEdges.push_back(-1);
+    isClone.push_back(false);
+    int p = last;
+    while (p != -1 && FindEdge(p, c) == -1) {
+        AddEdge(p, c, current);
+        p = links[p];
+    }
+    if (p != -1) {
+        int q = GetNext(p, c);
+        if (lengths[p] + 1 == lengths[q]) {
+            links[current] = q;
+        } else {
+            int clone = lengths.size();
+            lengths.push_back(lengths[p] + 1);
+            links.push_back(links[q]);
+            firstEdges.push_back(-1);
+            isClone.push_back(true);
+            for (int edge = firstEdges[q]; edge != -1; edge = nextEdges[edge]) {
+                AddEdge(clone, edgeChars[edge], edgeTargets[edge]);
+            }
+            // the links of p have a c edge too, since p does
+            while (p != -1) {
+                int edge = FindEdge(p, c);
+                if (edgeTargets[edge] != q) {
+                    break;
+                }
+                edgeTargets[edge] = clone;
+                p = links[p];
+            }
+            links[q] = clone;
+            links[current] = clone;
+        }
+    }
+    last = current;
+    // the new substrings are the suffixes of the prefix longer than the longest one seen before
+    uniqueSubstrings += lengths[current] - lengths[links[current]];
+}
+
+unsigned long long CSuffixAutomaton::CountUniqueSubstrings() const {
+    return uniqueSubstrings;
+}
+
+void CSuffixAutomaton::CountEndPositions() {
+    // each prefix ends in one non-clone state, a state's ends are those of its link subtree;
+    // states sorted by length by counting put children before links when traversed backwards
+    auto size = lengths.size();
+    std::vector<size_t> lengthCounts(lengths[last] + 2, 0);
+    for (auto length : lengths) {
+        ++lengthCounts[length + 1];
+    }
+    for (size_t length = 1; length < lengthCounts.size(); ++length) {
+        lengthCounts[length] += lengthCounts[length - 1];
+    }
+    std::vector<int> order(size);
+    for (size_t state = 0; state < size; ++state) {
+        order[lengthCounts[lengths[state]]++] = state;
+    }
+    endCounts.assign(size, 0);
+    for (size_t state = 1; state < size; ++state) {
+        endCounts[state] = isClone[state] ? 0 : 1;
+    }
+    for (size_t i = size; i-- > 1;) {
+        endCounts[links[order[i]]] += endCounts[order[i]];
+    }
+    isCountValid = true;
+}
+
+size_t CSuffixAutomaton::CountOccurrences(const std::string& pattern) {
+    if (!isCountValid) {
+        CountEndPositions();
+    }
+    int state = 0;
+    for (auto c : pattern) {
+        state = GetNext(state, c);
+        if (state == -1) {
+            return 0;
+        }
+    }
+    // the empty pattern occurs before every char and at the end
+    return state == 0 ? lengths[last] + 1 : endCounts[state];
+}
+
+std::pair<size_t, size_t> CSuffixAutomaton::FindLongestCommonSubstring(const std::string& other) const {
+    int state = 0;
+    size_t length = 0;
+    std::pair<size_t, size_t> answer(0, 0);
+    for (size_t i = 0; i < other.size(); ++i) {
+        while (state != 0 && GetNext(state, other[i]) == -1) {
+            state = links[state];
+            length = lengths[state];
+        }
+        int next = GetNext(state, other[i]);
+        if (next != -1) {
+            state = next;
+            ++length;
+        }
+        if (length > answer.second) {
+            answer = {i + 1 - length, length};
+        }
+    }
+    return answer;
+}
+
+// Range minimum over a static array: O(n log n) memory, O(1) per query on [left, right].
+template <typename T>
+class CSparseTable {
+public:
+    explicit CSparseTable(const std::vector<T>& values);
+    
+    size_t GetMinIndex(size_t left, size_t right) const;
+    T GetMin(size_t left, size_t right) const;
+    
+private:
+    std::vector<T> values;
+    // minIndices[level][i]: index of the minimum of values[i .. i + 2^level - 1], the leftmost one
+    std::vector<std::vector<size_t>> minIndices;
+    std::vector<int> levels;
+};
+
+template <typename T>
+CSparseTable<T>::CSparseTable(const std::vector<T>& values) : values(values) {
+    auto size = values.size();
+    levels.assign(size + 1, 0);
+    for (size_t length = 2; length <= size; ++length) {
+        levels[length] = levels[length / 2] + 1;
+    }
+    minIndices.emplace_back(size);
+    for (size_t i = 0; i < size; ++i) {
+        minIndices[0][i] = i;
+    }
+    for (int level = 1; (size_t(1) << level) <= size; ++level) {
+        const auto& previous = minIndices[level - 1];
+        std::vector<size_t> current(size - (size_t(1) << level) + 1);
+        for (size_t i = 0; i < current.size(); ++i) {
+            size_t left = previous[i];
+            size_t right = previous[i + (size_t(1) << (level - 1))];
+            current[i] = values[right] < values[left] ? right : left;
+        }
+        minIndices.push_back(std::move(current));
+    }
+}
+
+template <typename T>
+size_t CSparseTable<T>::GetMinIndex(size_t left, size_t right) const {
+    int level = levels[right - left + 1];
+    size_t first = minIndices[level][left];
+    size_t second = minIndices[level][right + 1 - (size_t(1) << level)];
+    return values[second] < values[first] ? second : first;
+}
+
+template <typename T>
+T CSparseTable<T>::GetMin(size_t left, size_t right) const {
+    return values[GetMinIndex(left, right)];
+}
+
+// Range minimum in O(n) space: a sparse table over the minima of blocks of 64 values, the ends
+// of a query are scanned. O(n) to build, O(blockSize) per query, the values are moved in.
+template <typename T>
+class CBlockSparseTable {
+public:
+    explicit CBlockSparseTable(std::vector<T> values);
+    
+    size_t GetMinIndex(size_t left, size_t right) const;
+    const T& operator[](size_t i) const;
+    
+private:
+    static const size_t blockSize = 64;
+    
+    // index of the leftmost minimum of values[left .. right] by a scan
+    size_t ScanMinIndex(size_t left, size_t right) const;
+    
+    std::vector<T> values;
+    std::vector<size_t> blockMinIndices;
+    CSparseTable<T> blockMin;
+};
+
+template <typename T>
+CBlockSparseTable<T>::CBlockSparseTable(std::vector<T> values) : values(std::move(values)), blockMin(std::vector<T>()) {
+    auto size = this->values.size();
+    std::vector<T> blockMinValues;
+    for (size_t begin = 0; begin < size; begin += blockSize) {
+        blockMinIndices.push_back(ScanMinIndex(begin, std::min(size, begin + blockSize) - 1));
+        blockMinValues.push_back(this->values[blockMinIndices.back()]);
+    }
+    blockMin = CSparseTable<T>(blockMinValues);
+}
+
+template <typename T>
+size_t CBlockSparseTable<T>::ScanMinIndex(size_t left, size_t right) const {
+    size_t minIndex = left;
+    for (size_t i = left + 1; i <= right; ++i) {
+        if (values[i] < values[minIndex]) {
+            minIndex = i;
+        }
+    }
+    return minIndex;
+}
+
+template <typename T>
+size_t CBlockSparseTable<T>::GetMinIndex(size_t left, size_t right) const {
+    size_t leftBlock = left / blockSize;
+    size_t rightBlock = right / blockSize;
+    if (leftBlock + 1 >= rightBlock) {
+        return ScanMinIndex(left, right);
+    }
+    size_t minIndex = ScanMinIndex(left, (leftBlock + 1) * blockSize - 1);
+    size_t middle = blockMinIndices[blockMin.GetMinIndex(leftBlock + 1, rightBlock - 1)];
+    size_t last = ScanMinIndex(rightBlock * blockSize, right);
+    if (values[middle] < values[minIndex]) {
+        minIndex = middle;
+    }
+    if (values[last] < values[minIndex]) {
+        minIndex = last;
+    }
+    return minIndex;
+}
+
+template <typename T>
+const T& CBlockSparseTable<T>::operator[](size_t i) const {
+    return values[i];
+}
+
+// Enhanced suffix array (Abouelhoda, Kurtz, Ohlebusch): the suffix array with its lcp array,
+// an RMQ over it and the child table, which together replace the suffix tree.
+// An lcp-interval [left, right] of value l is a maximal range of suffixes sharing a prefix of
+// length l, it corresponds to an internal suffix tree node.
+template <typename TIndex>
+class CEnhancedSuffixArray {
+public:
+    struct SInterval {
+        TIndex lcp;
+        TIndex left;
+        TIndex right;
+    };
+    
+    explicit CEnhancedSuffixArray(const CSuffixArray<TIndex>& suffixArray);
+    
+    // lcp of the suffixes starting at text positions first and second
+    TIndex GetLcp(TIndex first, TIndex second) const;
+    // children of an lcp-interval in suffix array order, found with the child table
+    std::vector<SInterval> GetChildIntervals(TIndex left, TIndex right) const;
+    // suffix array range of the suffixes starting with pattern by top-down search, empty if none
+    SInterval FindInterval(const std::string& pattern) const;
+    // calls visit(interval) for every lcp-interval, children before parents
+    template <typename TVisitor>
+    void TraverseLcpIntervals(TVisitor visit) const;
+    
+    SInterval FindLongestRepeat() const;
+    // repeats that cannot be extended to the left or to the right without losing an occurrence
+    std::vector<SInterval> FindMaximalRepeats(TIndex minLength) const;
+    
+    TIndex GetSuffix(TIndex i) const;
+    
+private:
+    TIndex GetIntervalLcp(TIndex left, TIndex right) const;
+    TIndex GetFirstLIndex(TIndex left, TIndex right) const;
+    
+    std::string text;
+    std::vector<TIndex> suffixArray;
+    std::vector<TIndex> reverseSuffixArray;
+    // lcp[i] = lcp of suffixes i - 1 and i of the suffix array, lcp[0] = lcp[size] = -1
+    std::vector<TIndex> lcp;
+    CSparseTable<TIndex> lcpMin;
+    std::vector<TIndex> up;
+    std::vector<TIndex> down;
+    std::vector<TIndex> nextLIndex;
+    // leftBreaks[i]: number of k <= i whose previous char differs from the one of k - 1 or is missing
+    std::vector<TIndex> leftBreaks;
+};
+
+template <typename TIndex>
+std::vector<TIndex> ShiftLcp(const std::vector<TIndex>& lcp) {
+    std::vector<TIndex> shifted(lcp.size() + 1, -1);
+    for (size_t i = 1; i < lcp.size(); ++i) {
+        shifted[i] = lcp[i - 1];
+    }
+    return shifted;
+}
+
+template <typename TIndex>
+CEnhancedSuffixArray<TIndex>::CEnhancedSuffixArray(const CSuffixArray<TIndex>& suffixArray) :
+        text(suffixArray.GetText()), suffixArray(suffixArray.GetSuffixArray()),
+        lcp(ShiftLcp(suffixArray.BuildLcp())), lcpMin(lcp) {
+    TIndex size = text.size();
+    reverseSuffixArray.resize(size);
+    for (TIndex i = 0; i < size; ++i) {
+        reverseSuffixArray[this->suffixArray[i]] = i;
+    }
+    
+    up.assign(size + 1, -1);
+    down.assign(size + 1, -1);
+    nextLIndex.assign(size + 1, -1);
+    std::vector<TIndex> stack(1, 0);
+    TIndex lastIndex = -1;
+    for (TIndex i = 1; i <= size; ++i) {
+        while (lcp[i] < lcp[stack.back()]) {
+            lastIndex = stack.back();
+            stack.pop_back();
+            if (lcp[i] <= lcp[stack.back()] && lcp[stack.back()] != lcp[lastIndex]) {
+                down[stack.back()] = lastIndex;
+            }
+        }
+        if (lastIndex != -1) {
+            up[i] = lastIndex;
+            lastIndex = -1;
+        }
+        stack.push_back(i);
+    }
+    stack.assign(1, 0);
+    for (TIndex i = 1; i <= size; ++i) {
+        while (lcp[i] < lcp[stack.back()]) {
+            stack.pop_back();
+        }
+        if (lcp[i] == lcp[stack.back()]) {
+            nextLIndex[stack.back()] = i;
+            stack.pop_back();
+        }
+        stack.push_back(i);
+    }
+    
+    leftBreaks.assign(size, 0);
+    for (TIndex i = 0; i < size; ++i) {
+        TIndex suffix = this->suffixArray[i];
+        bool isBreak = suffix == 0 || i == 0 || this->suffixArray[i - 1] == 0 ||
+                       text[suffix - 1] != text[this->suffixArray[i - 1] - 1];
+        leftBreaks[i] = (i > 0 ? leftBreaks[i - 1] : 0) + (isBreak ? 1 : 0);
+    }
+}
+
+template <typename TIndex>
+TIndex CEnhancedSuffixArray<TIndex>::GetSuffix(TIndex i) const {
+    return suffixArray[i];
+}
+
+template <typename TIndex>
+TIndex CEnhancedSuffixArray<TIndex>::GetLcp(TIndex first, TIndex second) const {
+    if (first == second) {
+        return text.size() - first;
+    }
+    TIndex left = std::min(reverseSuffixArray[first], reverseSuffixArray[second]);
+    TIndex right = std::max(reverseSuffixArray[first], reverseSuffixArray[second]);
+    return lcpMin.GetMin(left + 1, right);
+}
+
+template <typename TIndex>
+TIndex CEnhancedSuffixArray<TIndex>::GetFirstLIndex(TIndex left, TIndex right) const {
+    return left < up[right + 1] && up[right + 1] <= right ? up[right + 1] : down[left];
+}
+
+template <typename TIndex>
+TIndex CEnhancedSuffixArray<TIndex>::GetIntervalLcp(TIndex left, TIndex right) const {
+    if (left == right) {
+        return text.size() - suffixArray[left];
+    }
+    return lcp[GetFirstLIndex(left, right)];
+}
+
+template <typename TIndex>
+std::vector<typename CEnhancedSuffixArray<TIndex>::SInterval>
+CEnhancedSuffixArray<TIndex>::GetChildIntervals(TIndex left, TIndex right) const {
+    std::vector<SInterval> children;
+    if (left == right) {
+        return children;
+    }
+    TIndex childLeft = left;
+    for (TIndex lIndex = GetFirstLIndex(left, right); lIndex != -1 && lIndex <= right; lIndex = nextLIndex[lIndex]) {
+        children.push_back({GetIntervalLcp(childLeft, lIndex - 1), childLeft, lIndex - 1});
+        childLeft = lIndex;
+    }
+    children.push_back({GetIntervalLcp(childLeft, right), childLeft, right});
+    return children;
+}
+
+template <typename TIndex>
+typename CEnhancedSuffixArray<TIndex>::SInterval
+CEnhancedSuffixArray<TIndex>::FindInterval(const std::string& pattern) const {
+    TIndex size = text.size();
+    TIndex patternSize = pattern.size();
+    SInterval notFound = {0, 0, -1};
+    if (size == 0) {
+        return patternSize == 0 ? SInterval{0, 0, -1} : notFound;
+    }
+    SInterval current = {GetIntervalLcp(0, size - 1), 0, size - 1};
+    TIndex depth = 0;
+    while (depth < patternSize) {
+        // depth < current.lcp only at the root, whose common prefix is compared here
+        if (depth < current.lcp) {
+            TIndex suffix = suffixArray[current.left];
+            TIndex end = std::min(current.lcp, patternSize);
+            for (; depth < end; ++depth) {
+                if (text[suffix + depth] != pattern[depth]) {
+                    return notFound;
+                }
+            }
+            continue;
+        }
+        if (current.left == current.right) {
+            return notFound;
+        }
+        bool isFound = false;
+        for (const auto& child : GetChildIntervals(current.left, current.right)) {
+            TIndex suffix = suffixArray[child.left];
+            if (suffix + depth < size && text[suffix + depth] == pattern[depth]) {
+                current = child;
+                isFound = true;
+                break;
+            }
+        }
+        if (!isFound) {
+            return notFound;
+        }
+    }
+    current.lcp = patternSize;
+    return current;
+}
+
+template <typename TIndex>
+template <typename TVisitor>
+void CEnhancedSuffixArray<TIndex>::TraverseLcpIntervals(TVisitor visit) const {
+    TIndex size = text.size();
+    std::vector<SInterval> stack(1, SInterval{0, 0, -1});
+    for (TIndex i = 1; i <= size; ++i) {
+        TIndex currentLcp = i < size ? lcp[i] : -1;
+        TIndex left = i - 1;
+        while (!stack.empty() && currentLcp < stack.back().lcp) {
+            SInterval interval = stack.back();
+            stack.pop_back();
+            interval.right = i - 1;
+            visit(interval);
+            left = interval.left;
+        }
+        if (stack.empty() || currentLcp > stack.back().lcp) {
+            if (currentLcp >= 0) {
+                stack.push_back({currentLcp, left, -1});
+            }
+        }
+    }
+    if (!stack.empty() && size > 0) {
+        SInterval root = stack.back();
+        root.right = size - 1;
+        visit(root);
+    }
+}
+
+template <typename TIndex>
+typename CEnhancedSuffixArray<TIndex>::SInterval CEnhancedSuffixArray<TIndex>::FindLongestRepeat() const {
+    SInterval longest = {0, 0, -1};
+    TraverseLcpIntervals([&longest](const SInterval& interval) {
+        if (interval.lcp > longest.lcp) {
+            longest = interval;
+        }
+    });
+    return longest;
+}
+
+template <typename TIndex>
+std::vector<typename CEnhancedSuffixArray<TIndex>::SInterval>
+CEnhancedSuffixArray<TIndex>::FindMaximalRepeats(TIndex minLength) const {
+    std::vector<SInterval> repeats;
+    TraverseLcpIntervals([&](const SInterval& interval) {
+        // right maximal as an lcp-interval, left maximal if the previous chars are not all the same
+        bool isLeftDiverse = leftBreaks[interval.right] - leftBreaks[interval.left] > 0;
+        if (interval.lcp >= std::max<TIndex>(minLength, 1) && isLeftDiverse) {
+            repeats.push_back(interval);
+        }
+    });
+    return repeats;
+}
+
+// Longest common substring of two strings from the adjacent suffixes of first + separator + second.
+// Returns the start in first and the length.
+template <typename TIndex = int>
+std::pair<TIndex, TIndex> FindLongestCommonSubstring(const std::string& first, const std::string& second) {
+    // chars are shifted by one so that 0 is a separator occurring nowhere else
+    std::vector<TIndex> joined;
+    joined.reserve(first.size() + second.size() + 1);
+    for (auto c : first) {
+        joined.push_back(static_cast<unsigned char>(c) + 1);
+    }
+    joined.push_back(0);
+    for (auto c : second) {
+        joined.push_back(static_cast<unsigned char>(c) + 1);
+    }
+    std::vector<TIndex> suffixArray = BuildSuffixArraySais<TIndex>(joined, 256);
+    std::vector<TIndex> lcp = BuildLcpArray(joined, suffixArray);
+    TIndex firstSize = first.size();
+    std::pair<TIndex, TIndex> answer(0, 0);
+    for (size_t i = 0; i + 1 < suffixArray.size(); ++i) {
+        TIndex left = suffixArray[i];
+        TIndex right = suffixArray[i + 1];
+        if ((left < firstSize) != (right < firstSize) && lcp[i] > answer.second) {
+            answer = {std::min(left, right), lcp[i]};
+        }
+    }
+    return answer;
+}
+
+// Suffix array of a document collection: document d is followed by its own sentinel d,
+// chars are shifted above all sentinels, so no common prefix crosses a document end.
+// Built once for the whole collection with SA-IS instead of once per document.
+template <typename TIndex = int>
+class CGeneralizedSuffixArray {
+public:
+    explicit CGeneralizedSuffixArray(const std::vector<std::string>& documents);
     
-    std::vector<int> GetSuffixArray() const;
-    std::vector<int> BuildLcp() const;
+    // [begin, end) range of the suffix array starting with pattern
+    std::pair<TIndex, TIndex> FindRange(const std::string& pattern) const;
+    // each document containing pattern once, O(m log n + documents) (Muthukrishnan);
+    // the RMQ it needs is built by the first call, in O(n) time and about 4 bytes per char
+    std::vector<TIndex> ListDocuments(const std::string& pattern);
+    // at most k (document, occurrences) pairs with the most occurrences of pattern, O(occurrences)
+    std::vector<std::pair<TIndex, TIndex>> FindTopDocuments(const std::string& pattern, size_t k) const;
+    // number of distinct substrings of all documents together, no substring crosses a document end
+    unsigned long long CountUniqueSubstrings() const;
     
-    int CountUniqueSubstrings(const std::string& text);
+    TIndex GetDocument(TIndex position) const;
     
 private:
-    void Build(int);
-    int SeparateToClasses();
+    // compares the suffix with pattern as a prefix of it
+    int Compare(TIndex suffix, const std::string& pattern) const;
     
-    std::vector<int> suffixArray;
-    std::vector<int> classes;
-    std::string text;
-    static const int alphabetLen;
+    TIndex documentsCount;
+    std::vector<TIndex> sequence;
+    std::vector<TIndex> suffixArray;
+    std::vector<TIndex> lcp;
+    // documentIds[i]: document of the suffix i of the suffix array
+    std::vector<TIndex> documentIds;
+    // documentEnds[d]: position of the sentinel of the document d
+    std::vector<TIndex> documentEnds;
+    // over the previous suffix array index of the same document, -1 if none
+    std::unique_ptr<CBlockSparseTable<TIndex>> previousMin;
 };
 
-const int CSuffixArray::alphabetLen = 128;
+template <typename TIndex>
+std::vector<TIndex> BuildPreviousSameDocument(const std::vector<TIndex>& documentIds, TIndex documentsCount) {
+    std::vector<TIndex> previous(documentIds.size());
+    std::vector<TIndex> last(documentsCount, -1);
+    for (size_t i = 0; i < documentIds.size(); ++i) {
+        previous[i] = last[documentIds[i]];
+        last[documentIds[i]] = i;
+    }
+    return previous;
+}
+
+template <typename TIndex>
+CGeneralizedSuffixArray<TIndex>::CGeneralizedSuffixArray(const std::vector<std::string>& documents) :
+        documentsCount(documents.size()) {
+    for (TIndex document = 0; document < documentsCount; ++document) {
+        for (auto c : documents[document]) {
+            sequence.push_back(documentsCount + static_cast<unsigned char>(c));
+        }
+        documentEnds.push_back(sequence.size());
+        sequence.push_back(document);
+    }
+    suffixArray = BuildSuffixArraySais<TIndex>(sequence, documentsCount + 255);
+    lcp = BuildLcpArray(sequence, suffixArray);
+    
+    std::vector<TIndex> positionDocuments(sequence.size());
+    for (TIndex document = 0, position = 0; document < documentsCount; ++document) {
+        for (; position <= documentEnds[document]; ++position) {
+            positionDocuments[position] = document;
+        }
+    }
+    documentIds.resize(suffixArray.size());
+    for (size_t i = 0; i < suffixArray.size(); ++i) {
+        documentIds[i] = positionDocuments[suffixArray[i]];
+    }
+}
+
+template <typename TIndex>
+TIndex CGeneralizedSuffixArray<TIndex>::GetDocument(TIndex position) const {
+    return std::lower_bound(documentEnds.begin(), documentEnds.end(), position) - documentEnds.begin();
+}
+
+template <typename TIndex>
+int CGeneralizedSuffixArray<TIndex>::Compare(TIndex suffix, const std::string& pattern) const {
+    TIndex patternSize = pattern.size();
+    for (TIndex i = 0; i < patternSize; ++i) {
+        if (suffix + i == static_cast<TIndex>(sequence.size())) {
+            return -1;
+        }
+        TIndex symbol = documentsCount + static_cast<unsigned char>(pattern[i]);
+        if (sequence[suffix + i] != symbol) {
+            return sequence[suffix + i] < symbol ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+template <typename TIndex>
+std::pair<TIndex, TIndex> CGeneralizedSuffixArray<TIndex>::FindRange(const std::string& pattern) const {
+    auto begin = std::partition_point(suffixArray.begin(), suffixArray.end(), [&](TIndex suffix) {
+        return Compare(suffix, pattern) < 0;
+    });
+    auto end = std::partition_point(begin, suffixArray.end(), [&](TIndex suffix) {
+        return Compare(suffix, pattern) == 0;
+    });
+    return {begin - suffixArray.begin(), end - suffixArray.begin()};
+}
+
+template <typename TIndex>
+std::vector<TIndex> CGeneralizedSuffixArray<TIndex>::ListDocuments(const std::string& pattern) {
+    if (!previousMin) {
+        previousMin.reset(new CBlockSparseTable<TIndex>(BuildPreviousSameDocument(documentIds, documentsCount)));
+    }
+    auto range = FindRange(pattern);
+    std::vector<TIndex> documents;
+    // a document is met first in [left, right] at the index whose previous index is before left
+    std::vector<std::pair<TIndex, TIndex>> ranges;
+    if (range.first < range.second) {
+        ranges.emplace_back(range.first, range.second - 1);
+    }
+    while (!ranges.empty()) {
+        auto current = ranges.back();
+        ranges.pop_back();
+        TIndex minIndex = previousMin->GetMinIndex(current.first, current.second);
+        if ((*previousMin)[minIndex] >= range.first) {
+            continue;
+        }
+        documents.push_back(documentIds[minIndex]);
+        if (current.first < minIndex) {
+            ranges.emplace_back(current.first, minIndex - 1);
+        }
+        if (minIndex < current.second) {
+            ranges.emplace_back(minIndex + 1, current.second);
+        }
+    }
+    return documents;
+}
+
+template <typename TIndex>
+std::vector<std::pair<TIndex, TIndex>> CGeneralizedSuffixArray<TIndex>::FindTopDocuments(const std::string& pattern,
+                                                                                          size_t k) const {
+    auto range = FindRange(pattern);
+    std::unordered_map<TIndex, TIndex> occurrences;
+    for (TIndex i = range.first; i < range.second; ++i) {
+        ++occurrences[documentIds[i]];
+    }
+    std::vector<std::pair<TIndex, TIndex>> top(occurrences.begin(), occurrences.end());
+    auto byOccurrences = [](const std::pair<TIndex, TIndex>& left, const std::pair<TIndex, TIndex>& right) {
+        return left.second > right.second || (left.second == right.second && left.first < right.first);
+    };
+    k = std::min(k, top.size());
+    std::partial_sort(top.begin(), top.begin() + k, top.end(), byOccurrences);
+    top.resize(k);
+    return top;
+}
 
-CSuffixArray::CSuffixArray(const std::string& text) : text(text) {
-    auto size = this->text.size();
-    for (auto i = 0; i < size; ++i) {
-        suffixArray.emplace_back(i);
+template <typename TIndex>
+unsigned long long CGeneralizedSuffixArray<TIndex>::CountUniqueSubstrings() const {
+    unsigned long long answer = 0;
+    for (size_t i = 0; i < suffixArray.size(); ++i) {
+        // the sentinel is not a part of any substring, and lcp never includes it
+        answer += documentEnds[documentIds[i]] - suffixArray[i];
+        if (i > 0) {
+            answer -= lcp[i - 1];
+        }
     }
-    classes.resize(size);
+    return answer;
+}
+
+class CMappedFile {
+public:
+    explicit CMappedFile(const std::string& filename, int advice = MADV_SEQUENTIAL);
+    ~CMappedFile();
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
     
-    int classesNum = SeparateToClasses();
-    Build(classesNum);
+    const char* GetData() const;
+    size_t GetSize() const;
     
+private:
+    void* mapping;
+    size_t size;
+};
+
+CMappedFile::CMappedFile(const std::string& filename, int advice) : mapping(NULL), size(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0) {
+        std::cerr << "Failed open file";
+        exit(1);
+    }
+    size = fileStat.st_size;
+    if (size > 0) {
+        mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Failed map file";
+            exit(1);
+        }
+        // suffixes are read mostly in text order, indexes are probed at random
+        madvise(mapping, size, advice);
+    }
+    close(fd);
 }
-int CSuffixArray::SeparateToClasses() {
-    std::vector<int> cnt(alphabetLen);
-    auto size = text.size();
-    for (int i = 0; i < size; ++i) {
-        ++cnt[static_cast<int>(text[i])];
+
+CMappedFile::~CMappedFile() {
+    if (mapping != NULL) {
+        munmap(mapping, size);
+    }
+}
+
+const char* CMappedFile::GetData() const {
+    return static_cast<const char*>(mapping);
+}
+
+size_t CMappedFile::GetSize() const {
+    return size;
+}
+
+// Suffix symbols for the semi-external construction: chars are 1 .. 256, 0 is the end of the
+// text, so a suffix sorts before the longer ones it is a prefix of.
+inline uint16_t GetSuffixSymbol(const unsigned char* text, size_t size, size_t i) {
+    return i < size ? text[i] + 1 : 0;
+}
+
+// Sorts (key, suffix) items whose suffixes share their first depth symbols. Keys cache the next
+// 7 symbols (9 bits each), so the text is read once per 7 symbols of a common prefix, not on
+// every comparison; groups of equal keys go 7 symbols deeper.
+template <typename TIndex>
+void SortSuffixGroup(const unsigned char* text, size_t size, std::pair<uint64_t, TIndex>* begin,
+                     std::pair<uint64_t, TIndex>* end, size_t depth) {
+    const size_t keySymbols = 7;
+    struct SGroup {
+        std::pair<uint64_t, TIndex>* begin;
+        std::pair<uint64_t, TIndex>* end;
+        size_t depth;
+    };
+    std::vector<SGroup> groups = {{begin, end, depth}};
+    while (!groups.empty()) {
+        SGroup group = groups.back();
+        groups.pop_back();
+        if (group.end - group.begin < 2) {
+            continue;
+        }
+        for (auto* item = group.begin; item != group.end; ++item) {
+            uint64_t key = 0;
+            for (size_t k = 0; k < keySymbols; ++k) {
+                key = key << 9 | GetSuffixSymbol(text, size, item->second + group.depth + k);
+            }
+            item->first = key;
+        }
+        std::sort(group.begin, group.end);
+        // distinct suffixes with equal keys do not end within them, so equal keys only mean
+        // a longer common prefix
+        for (auto* runBegin = group.begin; runBegin != group.end;) {
+            auto* runEnd = runBegin + 1;
+            while (runEnd != group.end && runEnd->first == runBegin->first) {
+                ++runEnd;
+            }
+            if (runEnd - runBegin > 1) {
+                groups.push_back({runBegin, runEnd, group.depth + keySymbols});
+            }
+            runBegin = runEnd;
+        }
+    }
+}
+
+// Semi-external construction for texts larger than RAM. The text is mapped, not loaded. The
+// suffixes are split into buckets by prefix: by two chars first, then, with one scan of the
+// text per round, every bucket above the budget is split by one more char, for at most
+// maxRefinements rounds. Consecutive buckets are collected in passes of at most memoryBudget
+// bytes, one text scan each, and every bucket is sorted by SortSuffixGroup from the end of
+// its prefix. Peak memory is memoryBudget plus the bucket table, unless some prefix of
+// 2 + maxRefinements chars alone takes more (a long run of one char); such a bucket is sorted
+// over the budget. Suffixes with long common prefixes cost a text read per 7 chars of them.
+template <typename TIndex>
+void BuildSuffixArrayOnDisk(const std::string& textFilename, const std::string& suffixArrayFilename,
+                            size_t memoryBudget) {
+    const size_t maxRefinements = 16;
+    const size_t writeBlock = 1 << 16;
+    // the bucket scans read the text in order, but the sorts read suffixes at random
+    // positions, so sequential advice would let the kernel drop pages the sort still needs
+    CMappedFile textFile(textFilename, MADV_NORMAL);
+    const unsigned char* text = reinterpret_cast<const unsigned char*>(textFile.GetData());
+    size_t size = textFile.GetSize();
+    size_t capacity = std::max<size_t>(1, memoryBudget / sizeof(std::pair<uint64_t, TIndex>));
+    
+    struct SBucket {
+        std::vector<uint16_t> prefix;
+        size_t count;
+    };
+    std::vector<SBucket> buckets;
+    std::vector<size_t> keyCounts(257 * 257, 0);
+    for (size_t i = 0; i < size; ++i) {
+        ++keyCounts[GetSuffixSymbol(text, size, i) * 257 + GetSuffixSymbol(text, size, i + 1)];
+    }
+    for (size_t key = 0; key < keyCounts.size(); ++key) {
+        if (keyCounts[key] > 0) {
+            std::vector<uint16_t> prefix = {static_cast<uint16_t>(key / 257), static_cast<uint16_t>(key % 257)};
+            buckets.push_back({prefix, keyCounts[key]});
+        }
     }
+    // the bucket of suffix i is the last one whose prefix is not greater than the suffix
+    auto findBucket = [&](size_t i) {
+        auto next = std::upper_bound(buckets.begin(), buckets.end(), i, [&](size_t suffix, const SBucket& bucket) {
+            for (size_t k = 0; k < bucket.prefix.size(); ++k) {
+                uint16_t symbol = GetSuffixSymbol(text, size, suffix + k);
+                if (symbol != bucket.prefix[k]) {
+                    return symbol < bucket.prefix[k];
+                }
+            }
+            return false;
+        });
+        return static_cast<size_t>(next - buckets.begin()) - 1;
+    };
     
-    for (int i = 1; i < alphabetLen; ++i) {
-        cnt[i] += cnt[i - 1];
+    for (size_t round = 0; round < maxRefinements; ++round) {
+        std::vector<size_t> splitSlots(buckets.size(), 0);
+        std::vector<std::vector<size_t>> childCounts;
+        for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+            if (buckets[bucket].count > capacity && buckets[bucket].prefix.back() != 0) {
+                childCounts.emplace_back(257, 0);
+                splitSlots[bucket] = childCounts.size();
+            }
+        }
+        if (childCounts.empty()) {
+            break;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            size_t bucket = findBucket(i);
+            if (splitSlots[bucket] != 0) {
+                ++childCounts[splitSlots[bucket] - 1][GetSuffixSymbol(text, size, i + buckets[bucket].prefix.size())];
+            }
+        }
+        std::vector<SBucket> refined;
+        for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+            if (splitSlots[bucket] == 0) {
+                refined.push_back(std::move(buckets[bucket]));
+                continue;
+            }
+            const auto& counts = childCounts[splitSlots[bucket] - 1];
+            for (size_t symbol = 0; symbol < counts.size(); ++symbol) {
+                if (counts[symbol] > 0) {
+                    refined.push_back({buckets[bucket].prefix, counts[symbol]});
+                    refined.back().prefix.push_back(symbol);
+                }
+            }
+        }
+        buckets.swap(refined);
     }
     
-    for (int i = 0; i < size; ++i) {
-        suffixArray[--cnt[static_cast<int>(text[i])]] = i;
+    FILE *file = fopen(suffixArrayFilename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed open file";
+        exit(1);
+    }
+    // a pass is a run of buckets of at most capacity items, or a single larger bucket
+    std::vector<size_t> passBegins = {0};
+    size_t maxPassSize = 0;
+    for (size_t bucket = 0, passSize = 0; bucket < buckets.size(); ++bucket) {
+        if (passSize > 0 && passSize + buckets[bucket].count > capacity) {
+            passBegins.push_back(bucket);
+            passSize = 0;
+        }
+        passSize += buckets[bucket].count;
+        maxPassSize = std::max(maxPassSize, passSize);
+    }
+    passBegins.push_back(buckets.size());
+    // reserved once, so that growing it never holds two copies
+    std::vector<std::pair<uint64_t, TIndex>> items;
+    items.reserve(maxPassSize);
+    std::vector<TIndex> sorted;
+    for (size_t pass = 0; pass + 1 < passBegins.size(); ++pass) {
+        size_t firstBucket = passBegins[pass];
+        size_t lastBucket = passBegins[pass + 1];
+        // item offsets of the buckets of this pass
+        std::vector<size_t> offsets = {0};
+        for (size_t bucket = firstBucket; bucket < lastBucket; ++bucket) {
+            offsets.push_back(offsets.back() + buckets[bucket].count);
+        }
+        items.resize(offsets.back());
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < size; ++i) {
+            size_t bucket = findBucket(i);
+            if (bucket >= firstBucket && bucket < lastBucket) {
+                items[next[bucket - firstBucket]++] = {0, static_cast<TIndex>(i)};
+            }
+        }
+        for (size_t bucket = firstBucket; bucket < lastBucket; ++bucket) {
+            SortSuffixGroup(text, size, items.data() + offsets[bucket - firstBucket],
+                            items.data() + offsets[bucket - firstBucket + 1], buckets[bucket].prefix.size());
+        }
+        for (size_t begin = 0; begin < items.size(); begin += writeBlock) {
+            sorted.clear();
+            for (size_t i = begin; i < std::min(items.size(), begin + writeBlock); ++i) {
+                sorted.push_back(items[i].second);
+            }
+            if (fwrite(sorted.data(), sizeof(TIndex), sorted.size(), file) != sorted.size()) {
+                std::cerr << "Failed write file";
+                exit(1);
+            }
+        }
     }
+    if (fclose(file) != 0) {
+        std::cerr << "Failed write file";
+        exit(1);
+    }
+}
+
+// Bit vector with rank support inside a flat uint64_t image: every 512 bits are preceded
+// by one word holding the number of ones before them, 12.5% overhead.
+const size_t rankBlockBits = 512;
+const size_t rankBlockWords = rankBlockBits / 64 + 1;
+
+size_t GetRankBitVectorWords(size_t size) {
+    return (size / rankBlockBits + 1) * rankBlockWords;
+}
+
+void BuildRankBitVector(const std::vector<bool>& bits, uint64_t* words) {
+    auto size = bits.size();
+    std::fill(words, words + GetRankBitVectorWords(size), 0);
+    for (size_t i = 0; i < size; ++i) {
+        if (bits[i]) {
+            words[i / rankBlockBits * rankBlockWords + 1 + i % rankBlockBits / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+    uint64_t ones = 0;
+    for (size_t block = 0; block <= size / rankBlockBits; ++block) {
+        uint64_t* current = words + block * rankBlockWords;
+        current[0] = ones;
+        for (size_t k = 1; k < rankBlockWords; ++k) {
+            ones += __builtin_popcountll(current[k]);
+        }
+    }
+}
+
+class CRankBitVector {
+public:
+    CRankBitVector() : words(NULL) {}
+    explicit CRankBitVector(const uint64_t* words) : words(words) {}
     
-    classes[suffixArray[0]] = 0;
-    int classesNum = 1;
+    bool Get(size_t i) const {
+        return (words[i / rankBlockBits * rankBlockWords + 1 + i % rankBlockBits / 64] >> (i % 64)) & 1;
+    }
     
-    for (int i = 1; i < size; ++i) {
-        if (text[suffixArray[i]] != text[suffixArray[i - 1]]) {
-            ++classesNum;
+    // number of ones in [0, i)
+    size_t Rank(size_t i) const {
+        const uint64_t* block = words + i / rankBlockBits * rankBlockWords;
+        size_t ones = block[0];
+        size_t word = i % rankBlockBits / 64;
+        for (size_t k = 0; k < word; ++k) {
+            ones += __builtin_popcountll(block[1 + k]);
         }
-        classes[suffixArray[i]] = classesNum - 1;
+        if (i % 64 != 0) {
+            ones += __builtin_popcountll(block[1 + word] & ((uint64_t(1) << (i % 64)) - 1));
+        }
+        return ones;
     }
     
-    return classesNum;
+private:
+    const uint64_t* words;
+};
+
+struct SFMIndexHeader {
+    uint64_t magic;
+    uint64_t version;
+    // text size plus one for the sentinel
+    uint64_t size;
+    uint64_t alphabetSize;
+    // the longest code
+    uint64_t levelCount;
+    uint64_t sampleRate;
+    uint64_t sampleWidth;
+    uint64_t wordCount;
+};
+
+const uint64_t fmIndexMagic = 0x5844494d46; // "FMIDX"
+const uint64_t fmIndexVersion = 2;
+const size_t fmHeaderWords = sizeof(SFMIndexHeader) / sizeof(uint64_t);
+
+// Code lengths of a Huffman code for the given frequencies, one symbol gets length 1.
+std::vector<uint64_t> GetHuffmanLengths(const std::vector<uint64_t>& frequencies) {
+    size_t symbolsCount = frequencies.size();
+    std::vector<uint64_t> lengths(symbolsCount, 1);
+    if (symbolsCount < 2) {
+        return lengths;
+    }
+    std::vector<size_t> parents(2 * symbolsCount - 1);
+    std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t>>,
+                        std::greater<std::pair<uint64_t, size_t>>> queue;
+    for (size_t symbol = 0; symbol < symbolsCount; ++symbol) {
+        queue.emplace(frequencies[symbol], symbol);
+    }
+    for (size_t node = symbolsCount; node < parents.size(); ++node) {
+        auto first = queue.top();
+        queue.pop();
+        auto second = queue.top();
+        queue.pop();
+        parents[first.second] = parents[second.second] = node;
+        queue.emplace(first.first + second.first, node);
+    }
+    // parents have larger ids, so depths are known when going down
+    std::vector<uint64_t> depths(parents.size(), 0);
+    for (size_t node = parents.size() - 1; node-- > 0;) {
+        depths[node] = depths[parents[node]] + 1;
+    }
+    std::copy(depths.begin(), depths.begin() + symbolsCount, lengths.begin());
+    return lengths;
 }
 
-void CSuffixArray::Build(int classesNum) {
-    auto size = text.size();
-    std::vector<int> currentPermutation(size);
-    std::vector<int> newClasses(size);
+// Prefix free codes of the given lengths shaped for a wavelet matrix. After d levels the matrix
+// orders elements by their first d bits read backwards, so at each depth the codes ending there
+// take the nodes largest in that order: they go to the end of the level and the next level
+// is just cut shorter, no bit is stored for them.
+std::vector<uint64_t> GetWaveletCodes(const std::vector<uint64_t>& lengths) {
+    std::vector<uint64_t> codes(lengths.size(), 0);
+    auto reversed = [](uint64_t code, uint64_t length) {
+        uint64_t result = 0;
+        for (uint64_t bit = 0; bit < length; ++bit) {
+            result = result << 1 | ((code >> bit) & 1);
+        }
+        return result;
+    };
+    std::vector<uint64_t> nodes(1, 0);
+    uint64_t maxLength = lengths.empty() ? 0 : *std::max_element(lengths.begin(), lengths.end());
+    for (uint64_t length = 1; length <= maxLength; ++length) {
+        std::vector<uint64_t> children;
+        for (auto node : nodes) {
+            children.push_back(node << 1);
+            children.push_back(node << 1 | 1);
+        }
+        std::sort(children.begin(), children.end(), [&](uint64_t left, uint64_t right) {
+            return reversed(left, length) > reversed(right, length);
+        });
+        size_t used = 0;
+        for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+            if (lengths[symbol] == length) {
+                codes[symbol] = children[used++];
+            }
+        }
+        nodes.assign(children.begin() + used, children.end());
+    }
+    return codes;
+}
+
+// FM-index: the BWT of text + sentinel kept in a Huffman-shaped wavelet matrix, plus the suffix
+// array sampled at text positions divisible by sampleRate.
+// Takes about 1.125 * n * H0 / 8 bytes for the BWT (H0 is the entropy of a char in bits, 12.5% is
+// the rank overhead), 1.125 * n / 8 bytes for the sample marks and n * log2(n) / (8 * sampleRate)
+// bytes for the samples: about 0.5 n bytes for DNA and 0.8 n for English text with the default
+// sample rate of 64; only bytes close to uniformly random take more than n.
+// The image is a flat array of words, so it is saved as is and loaded with mmap.
+class CFMIndex {
+public:
+    explicit CFMIndex(std::vector<uint64_t>&& image);
+    explicit CFMIndex(const std::string& filename);
+    
+    void Save(const std::string& filename) const;
+    size_t GetSizeInBytes() const;
+    
+    size_t Count(const std::string& pattern) const;
+    // text positions of the occurrences in no particular order
+    std::vector<size_t> Locate(const std::string& pattern) const;
+    
+private:
+    void Attach(const uint64_t* words, size_t wordCount);
+    // [begin, end) range of BWT rows prefixed by pattern
+    std::pair<size_t, size_t> FindRows(const std::string& pattern) const;
+    // number of symbol occurrences in BWT[0, i)
+    size_t Rank(size_t symbol, size_t i) const;
+    // BWT[i] and its rank among equal symbols before i
+    size_t Access(size_t i, size_t& rank) const;
+    size_t GetSample(size_t i) const;
+    
+    std::vector<uint64_t> ownImage;
+    std::unique_ptr<CMappedFile> file;
+    
+    const uint64_t* image;
+    SFMIndexHeader header;
+    // symbol of each char, 0 is the sentinel and the chars get 1.. in their order
+    const uint64_t* codes;
+    const uint64_t* counts;
+    // wavelet matrix code and its length for each symbol
+    const uint64_t* bitCodes;
+    const uint64_t* bitLengths;
+    // position of the first occurrence of each symbol in the level its code ends at
+    const uint64_t* starts;
+    // symbols sorted by code length, then by start; those of length l begin at endingBegins[l]
+    const uint64_t* endings;
+    const uint64_t* endingBegins;
+    // elements left at each level and zeros among them
+    const uint64_t* levelSizes;
+    const uint64_t* zeros;
+    std::vector<CRankBitVector> levels;
+    CRankBitVector marks;
+    const uint64_t* samples;
+};
+
+template <typename TIndex>
+std::vector<uint64_t> CompileFMIndex(const CSuffixArray<TIndex>& suffixArray, size_t sampleRate = 64) {
+    const std::string& text = suffixArray.GetText();
+    std::vector<TIndex> textSuffixArray = suffixArray.GetSuffixArray();
+    size_t size = text.size() + 1;
     
-    for (int height = 0; (1 << height) < size; ++height) {
-        for (int i = 0; i < size; ++i) {
-            currentPermutation[i] = (size + suffixArray[i] - (1 << height)) % size;
+    std::vector<uint64_t> codes(256, 0);
+    for (auto c : text) {
+        codes[static_cast<unsigned char>(c)] = 1;
+    }
+    uint64_t alphabetSize = 1;
+    for (auto& code : codes) {
+        if (code != 0) {
+            code = alphabetSize++;
         }
-        std::vector<int> cnt(classesNum);
-        for (int i = 0; i < size; ++i) {
-            ++cnt[classes[currentPermutation[i]]];
+    }
+    uint64_t sampleWidth = 1;
+    while ((uint64_t(1) << sampleWidth) < size) {
+        ++sampleWidth;
+    }
+    
+    // the suffix of the sentinel alone is the smallest one
+    std::vector<uint16_t> bwt(size);
+    std::vector<bool> isMarked(size);
+    std::vector<uint64_t> sampled;
+    std::vector<uint64_t> counts(alphabetSize + 1, 0);
+    for (size_t i = 0; i < size; ++i) {
+        size_t position = i == 0 ? size - 1 : textSuffixArray[i - 1];
+        bwt[i] = position == 0 ? 0 : codes[static_cast<unsigned char>(text[position - 1])];
+        ++counts[bwt[i] + 1];
+        if (position % sampleRate == 0) {
+            isMarked[i] = true;
+            sampled.push_back(position);
         }
-        
-        for (int i = 1; i < classesNum; ++i) {
-            cnt[i] += cnt[i - 1];
+    }
+    std::vector<uint64_t> bitLengths = GetHuffmanLengths(std::vector<uint64_t>(counts.begin() + 1, counts.end()));
+    std::vector<uint64_t> bitCodes = GetWaveletCodes(bitLengths);
+    uint64_t levelCount = *std::max_element(bitLengths.begin(), bitLengths.end());
+    for (size_t symbol = 1; symbol <= alphabetSize; ++symbol) {
+        counts[symbol] += counts[symbol - 1];
+    }
+    
+    // wavelet matrix: each level stores the next code bit of the elements whose codes are longer,
+    // then stably moves the zeros before the ones
+    std::vector<uint64_t> levelSizes(levelCount);
+    std::vector<uint64_t> zeros(levelCount);
+    std::vector<uint64_t> starts(alphabetSize);
+    std::vector<std::vector<bool>> levelBits(levelCount);
+    std::vector<uint16_t> order = bwt;
+    std::vector<uint16_t> next;
+    for (size_t level = 0; level < levelCount; ++level) {
+        levelSizes[level] = order.size();
+        std::vector<bool>& bits = levelBits[level];
+        bits.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            uint16_t symbol = order[i];
+            bits[i] = (bitCodes[symbol] >> (bitLengths[symbol] - 1 - level)) & 1;
+            zeros[level] += bits[i] ? 0 : 1;
         }
-        
-        for (int i = size - 1; i >= 0; --i) {
-            suffixArray[--cnt[classes[currentPermutation[i]]]] = currentPermutation[i];
+        next.resize(order.size());
+        size_t zeroPosition = 0;
+        size_t onePosition = zeros[level];
+        for (size_t i = 0; i < order.size(); ++i) {
+            next[bits[i] ? onePosition++ : zeroPosition++] = order[i];
         }
-        
-        newClasses[suffixArray[0]] = 0;
-        classesNum = 1;
-        for (int i = 1; i < size; ++i) {
-            int mid1 = (suffixArray[i] + (1 << height)) % size,  mid2 = (suffixArray[i - 1] + (1 << height)) % size;
-            if (classes[suffixArray[i]] != classes[suffixArray[i - 1]] || classes[mid1] != classes[mid2])
-                ++classesNum;
-            newClasses[suffixArray[i]] = classesNum - 1;
+        // codes ending here are at the end, equal codes contiguous
+        size_t continuing = next.size();
+        while (continuing > 0 && bitLengths[next[continuing - 1]] == level + 1) {
+            --continuing;
+            starts[next[continuing]] = continuing;
         }
-        classes = newClasses;
+        next.resize(continuing);
+        order.swap(next);
+    }
+    std::vector<uint64_t> endings(alphabetSize);
+    for (size_t symbol = 0; symbol < alphabetSize; ++symbol) {
+        endings[symbol] = symbol;
+    }
+    std::sort(endings.begin(), endings.end(), [&](uint64_t left, uint64_t right) {
+        return std::make_pair(bitLengths[left], starts[left]) < std::make_pair(bitLengths[right], starts[right]);
+    });
+    std::vector<uint64_t> endingBegins(levelCount + 2, 0);
+    for (auto length : bitLengths) {
+        ++endingBegins[length + 1];
+    }
+    for (size_t length = 1; length < endingBegins.size(); ++length) {
+        endingBegins[length] += endingBegins[length - 1];
+    }
+    
+    size_t levelWords = 0;
+    for (auto levelSize : levelSizes) {
+        levelWords += GetRankBitVectorWords(levelSize);
+    }
+    size_t bitVectorWords = GetRankBitVectorWords(size);
+    size_t sampleWords = (sampled.size() * sampleWidth + 63) / 64 + 1;
+    size_t wordCount = fmHeaderWords + 256 + (alphabetSize + 1) + 4 * alphabetSize + (levelCount + 2) +
+                       2 * levelCount + levelWords + bitVectorWords + sampleWords;
+    std::vector<uint64_t> image(wordCount, 0);
+    SFMIndexHeader header = {fmIndexMagic, fmIndexVersion, size, alphabetSize, levelCount, sampleRate,
+                             sampleWidth, wordCount};
+    std::memcpy(image.data(), &header, sizeof(header));
+    uint64_t* current = image.data() + fmHeaderWords;
+    for (const auto* table : {&codes, &counts, &bitCodes, &bitLengths, &starts, &endings, &endingBegins,
+                              &levelSizes, &zeros}) {
+        current = std::copy(table->begin(), table->end(), current);
+    }
+    for (const auto& bits : levelBits) {
+        BuildRankBitVector(bits, current);
+        current += GetRankBitVectorWords(bits.size());
     }
     
+    BuildRankBitVector(isMarked, current);
+    current += bitVectorWords;
+    for (size_t i = 0; i < sampled.size(); ++i) {
+        size_t bit = i * sampleWidth;
+        current[bit / 64] |= sampled[i] << (bit % 64);
+        if (bit % 64 + sampleWidth > 64) {
+            current[bit / 64 + 1] |= sampled[i] >> (64 - bit % 64);
+        }
+    }
+    return image;
 }
 
-std::vector<int> CSuffixArray::BuildLcp() const{
-    auto size = text.size();
-    std::vector<int> lcp(size);
-    std::vector<int> reverseSuffixArray(size);
-    
-    for (int i = 0; i < size; ++i) {
-        reverseSuffixArray[suffixArray[i]] = i;
+CFMIndex::CFMIndex(std::vector<uint64_t>&& image) : ownImage(std::move(image)) {
+    Attach(ownImage.data(), ownImage.size());
+}
+
+CFMIndex::CFMIndex(const std::string& filename) : file(new CMappedFile(filename, MADV_RANDOM)) {
+    Attach(reinterpret_cast<const uint64_t*>(file->GetData()), file->GetSize() / sizeof(uint64_t));
+}
+
+void CFMIndex::Attach(const uint64_t* words, size_t wordCount) {
+    image = words;
+    if (wordCount < fmHeaderWords) {
+        std::cerr << "Unsupported index file";
+        exit(1);
     }
-    int k = 0;
-    for (int i = 0; i < size; ++i) {
-        if (k > 0) {
-            --k;
+    std::memcpy(&header, image, sizeof(header));
+    if (header.magic != fmIndexMagic || header.version != fmIndexVersion || header.wordCount != wordCount ||
+        header.alphabetSize == 0 || header.alphabetSize > 257 || header.levelCount > 64 || header.sampleRate == 0 ||
+        header.sampleWidth == 0 || header.sampleWidth > 64 ||
+        fmHeaderWords + 256 + 5 * header.alphabetSize + 3 * header.levelCount + 3 > wordCount) {
+        std::cerr << "Unsupported index file";
+        exit(1);
+    }
+    codes = image + fmHeaderWords;
+    counts = codes + 256;
+    bitCodes = counts + header.alphabetSize + 1;
+    bitLengths = bitCodes + header.alphabetSize;
+    starts = bitLengths + header.alphabetSize;
+    endings = starts + header.alphabetSize;
+    endingBegins = endings + header.alphabetSize;
+    levelSizes = endingBegins + header.levelCount + 2;
+    zeros = levelSizes + header.levelCount;
+    // the bit vectors and the samples must fit into the image
+    size_t offset = zeros + header.levelCount - image;
+    levels.clear();
+    for (size_t level = 0; level < header.levelCount; ++level) {
+        if (levelSizes[level] > header.size) {
+            std::cerr << "Unsupported index file";
+            exit(1);
         }
-        if (reverseSuffixArray[i] == size - 1) {
-            lcp[size - 1] = -1;
-            k = 0;
-            continue;
+        levels.emplace_back(image + offset);
+        offset += GetRankBitVectorWords(levelSizes[level]);
+    }
+    marks = CRankBitVector(image + offset);
+    offset += GetRankBitVectorWords(header.size);
+    samples = image + offset;
+    offset += ((header.size - 1) / header.sampleRate + 1) * header.sampleWidth / 64 + 1;
+    if (offset > wordCount) {
+        std::cerr << "Unsupported index file";
+        exit(1);
+    }
+}
+
+void CFMIndex::Save(const std::string& filename) const {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed open file";
+        exit(1);
+    }
+    size_t written = fwrite(image, sizeof(uint64_t), header.wordCount, file);
+    if (fclose(file) != 0 || written != header.wordCount) {
+        std::cerr << "Failed write file";
+        exit(1);
+    }
+}
+
+size_t CFMIndex::GetSizeInBytes() const {
+    return header.wordCount * sizeof(uint64_t);
+}
+
+size_t CFMIndex::Rank(size_t symbol, size_t i) const {
+    uint64_t length = bitLengths[symbol];
+    for (size_t level = 0; level < length; ++level) {
+        if ((bitCodes[symbol] >> (length - 1 - level)) & 1) {
+            i = zeros[level] + levels[level].Rank(i);
         } else {
-            int j = suffixArray[reverseSuffixArray[i] + 1];
-            while (std::max(i + k, j + k) < size && text[i + k] == text[j + k]) {
-                ++k;
-            }
-            lcp[reverseSuffixArray[i]] = k;
+            i -= levels[level].Rank(i);
         }
     }
+    return i - starts[symbol];
+}
 
-    return lcp;
+size_t CFMIndex::Access(size_t i, size_t& rank) const {
+    size_t level = 0;
+    while (level < header.levelCount && i < levelSizes[level]) {
+        if (levels[level].Get(i)) {
+            i = zeros[level] + levels[level].Rank(i);
+        } else {
+            i -= levels[level].Rank(i);
+        }
+        ++level;
+    }
+    // the code ended at this level: the symbol is the last one of its length starting not after i
+    const uint64_t* symbol = std::upper_bound(endings + endingBegins[level], endings + endingBegins[level + 1], i,
+                                              [this](size_t position, uint64_t other) {
+        return position < starts[other];
+    }) - 1;
+    rank = i - starts[*symbol];
+    return *symbol;
 }
 
-std::vector<int> CSuffixArray::GetSuffixArray() const{
-    return suffixArray;
+size_t CFMIndex::GetSample(size_t i) const {
+    size_t bit = i * header.sampleWidth;
+    uint64_t value = samples[bit / 64] >> (bit % 64);
+    if (bit % 64 + header.sampleWidth > 64) {
+        value |= samples[bit / 64 + 1] << (64 - bit % 64);
+    }
+    return value & ((uint64_t(1) << header.sampleWidth) - 1);
 }
 
-int CSuffixArray::CountUniqueSubstrings(const std::string& text) {
-    CSuffixArray suffArr(text);
-    std::vector<int> lcp = suffArr.BuildLcp();
-    auto size = text.size();
-    int answer = 0;
-    for (auto element : suffArr.GetSuffixArray()) {
-        answer += size - element;
+std::pair<size_t, size_t> CFMIndex::FindRows(const std::string& pattern) const {
+    size_t begin = 0;
+    size_t end = header.size;
+    for (size_t i = pattern.size(); i-- > 0 && begin < end;) {
+        size_t code = codes[static_cast<unsigned char>(pattern[i])];
+        if (code == 0) {
+            return {0, 0};
+        }
+        begin = counts[code] + Rank(code, begin);
+        end = counts[code] + Rank(code, end);
     }
-    for (int i = 0; i < size - 1; ++i) {
-        answer -= lcp[i];
+    return {begin, end};
+}
+
+size_t CFMIndex::Count(const std::string& pattern) const {
+    auto rows = FindRows(pattern);
+    return rows.second - rows.first;
+}
+
+std::vector<size_t> CFMIndex::Locate(const std::string& pattern) const {
+    auto rows = FindRows(pattern);
+    std::vector<size_t> positions;
+    positions.reserve(rows.second - rows.first);
+    for (size_t row = rows.first; row < rows.second; ++row) {
+        // walk the text backwards with LF until a sampled position
+        size_t current = row;
+        size_t steps = 0;
+        while (!marks.Get(current)) {
+            size_t rank;
+            size_t code = Access(current, rank);
+            current = counts[code] + rank;
+            ++steps;
+        }
+        positions.push_back(GetSample(marks.Rank(current)) + steps);
     }
-    return answer;
+    return positions;
 }
 
-int main() {
+// Usage:
+//   main                  reads the text and prints the number of its distinct substrings
+//   main --threads <n>    the same, building the suffix array with n threads
+//   main --benchmark      reads the text and reports the build time for 1 to 64 threads to stderr,
+//                         then the cost of counting distinct substrings of a growing text
+//                         by rebuilding the suffix array against appending to the suffix automaton
+//   main --external <text file> <suffix array file> [<memory in MB>]
+//                         writes the 64-bit suffix array of the text file, using about the given memory
+//   main --prefixes       reads the text and prints the number of distinct substrings of each prefix
+//   main --lcp            reads the text, then lines "i j" and prints the lcp of the suffixes i and j,
+//                         from prefix hashes: O(n) to build and O(log n) per query, no suffix array;
+//                         "Invalid position" unless both are below the text size
+//   main --documents      reads one document per line and prints the number of distinct substrings
+//                         of all of them
+//   main --fm-index <index file>
+//                         reads the text and saves its FM-index
+//   main --fm-locate <index file>
+//                         loads the FM-index and prints the count and the positions of each pattern line
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    
+    if (mode == "--external" && argc > 3) {
+        size_t memoryBudget = (argc > 4 ? std::stoul(argv[4]) : 1024) << 20;
+        BuildSuffixArrayOnDisk<long long>(argv[2], argv[3], memoryBudget);
+        return 0;
+    }
+    
+    if (mode == "--fm-locate" && argc > 2) {
+        CFMIndex index(argv[2]);
+        std::string pattern;
+        while (std::getline(std::cin, pattern)) {
+            std::vector<size_t> positions = index.Locate(pattern);
+            std::sort(positions.begin(), positions.end());
+            std::cout << positions.size();
+            for (auto position : positions) {
+                std::cout << ' ' << position;
+            }
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+    
+    if (mode == "--documents") {
+        std::vector<std::string> documents;
+        std::string document;
+        while (std::getline(std::cin, document)) {
+            documents.push_back(document);
+        }
+        std::cout << CGeneralizedSuffixArray<>(documents).CountUniqueSubstrings() << std::endl;
+        return 0;
+    }
+    
+    if (mode == "--prefixes") {
+        CSuffixAutomaton automaton;
+        for (int c = std::cin.get(); c != EOF && c != '\n'; c = std::cin.get()) {
+            automaton.Append(c);
+            std::cout << automaton.CountUniqueSubstrings() << '\n';
+        }
+        return 0;
+    }
+    
     std::string text;
     std::getline(std::cin, text);
-    CSuffixArray suffixArray(text);
-    std::cout << suffixArray.CountUniqueSubstrings(text) << std::endl;
+    
+    if (mode == "--lcp") {
+        CRollingHash hashes(text);
+        size_t first, second;
+        while (std::cin >> first >> second) {
+            if (first >= text.size() || second >= text.size()) {
+                std::cout << "Invalid position\n";
+                continue;
+            }
+            std::cout << hashes.GetCommonPrefix(first, second) << '\n';
+        }
+        return 0;
+    }
+    
+    if (mode == "--fm-index" && argc > 2) {
+        CFMIndex(CompileFMIndex(CSuffixArray<>(text))).Save(argv[2]);
+        return 0;
+    }
+    
+    if (mode == "--benchmark") {
+        std::vector<int> expected = CSuffixArray<>(text).GetSuffixArray();
+        for (size_t threadsCount = 1; threadsCount <= 64; threadsCount *= 2) {
+            auto start = std::chrono::steady_clock::now();
+            CSuffixArray<> suffixArray(text, threadsCount);
+            double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << threadsCount << " threads: " << time << " s" << std::endl;
+            if (suffixArray.GetSuffixArray() != expected) {
+                std::cerr << "suffix arrays differ" << std::endl;
+                return 1;
+            }
+        }
+        
+        // the text arrives in 64 chunks, the count is asked after each of them
+        size_t chunkSize = std::max<size_t>(1, text.size() / 64);
+        double rebuildTime = 0;
+        double appendTime = 0;
+        CSuffixAutomaton automaton;
+        for (size_t end = chunkSize; end <= text.size(); end += chunkSize) {
+            auto start = std::chrono::steady_clock::now();
+            auto rebuiltCount = CSuffixArray<>(text.substr(0, end)).CountUniqueSubstrings();
+            auto middle = std::chrono::steady_clock::now();
+            for (size_t i = end - chunkSize; i < end; ++i) {
+                automaton.Append(text[i]);
+            }
+            auto appendedCount = automaton.CountUniqueSubstrings();
+            auto finish = std::chrono::steady_clock::now();
+            rebuildTime += std::chrono::duration<double>(middle - start).count();
+            appendTime += std::chrono::duration<double>(finish - middle).count();
+            if (rebuiltCount != appendedCount) {
+                std::cerr << "distinct substring counts differ" << std::endl;
+                return 1;
+            }
+        }
+        std::cerr << "growing text, suffix array rebuilds: " << rebuildTime << " s" << std::endl;
+        std::cerr << "growing text, suffix automaton appends: " << appendTime << " s" << std::endl;
+        return 0;
+    }
+    
+    size_t threadsCount = mode == "--threads" && argc > 2 ? std::stoul(argv[2]) : 1;
+    CSuffixArray<> suffixArray(text, threadsCount);
+    std::cout << suffixArray.CountUniqueSubstrings() << std::endl;
     return 0;
 }
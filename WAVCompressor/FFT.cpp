@@ -2,11 +2,7 @@
 
 size_t FindUpperDegreeOfTwo( size_t base)
 {
-    size_t closestNumber = 1;
-    while ( closestNumber < base ) {
-        closestNumber *= 2;
-    }
-    return closestNumber * 2;
+    return RoundUpToDegreeOfTwo(base) * 2;
 }
 
 std::vector <cld> MakeComplexVector( const std::vector<int> & intVector, size_t n )
@@ -21,47 +17,24 @@ std::vector <cld> MakeComplexVector( const std::vector<int> & intVector, size_t
 
 void MakeGeneralFFT(std::vector <cld>& complexVector, cld shift)
 {
-    if (complexVector.size() == 1) {
-        return;
-    }
-    std::vector <cld> leftSide, rightSide;
-    auto size = complexVector.size();
-    leftSide.reserve(size);
-    rightSide.reserve(size);
-    for (size_t i = 0; i < size; i += 2) {
-        leftSide.push_back(complexVector[i]);
-        rightSide.push_back(complexVector[i + 1]);
-    }
-    
-    MakeGeneralFFT(leftSide, shift * shift);
-    MakeGeneralFFT(rightSide, shift * shift);
-
+    // the powers of shift play the roots of unity
+    std::vector <cld> roots(complexVector.size() / 2);
     cld w (1.0, 0.0);
-    
-    for (size_t i = 0; i < size / 2; i++) {
-        cld u = leftSide[i];
-        cld v = w * rightSide[i];
-        complexVector[i] = u + v;
-        complexVector[i +size / 2] = u - v;
+    for (size_t i = 0; i < roots.size(); i++) {
+        roots[i] = w;
         w *= shift;
     }
-    
+    MakeIterativeFFT(complexVector, roots, false);
 }
 
 void MakeFFT(std::vector <cld> &complexVector)
 {
-    long double angle = 2.0 * M_PI / complexVector.size();
-    MakeGeneralFFT(complexVector, cld(std::cosl(angle), std::sinl(angle)));
+    MakeIterativeFFT(complexVector, MakeRootsOfUnity<long double>(complexVector.size()), false);
 }
 
 void MakeInverseFFT(std::vector <cld>& complexVector)
 {
-    auto size = complexVector.size();
-    long double angle = 2.0 * M_PI / size;
-    MakeGeneralFFT(complexVector, cld(std::cosl(angle), -std::sinl(angle)));
-    for (size_t i = 0; i < size; i++) {
-        complexVector[i] /= size;
-    }
+    MakeIterativeFFT(complexVector, MakeRootsOfUnity<long double>(complexVector.size()), true);
 }
 
 std::vector <int> MakeIntVector(const std::vector<cld> & complexVector)
@@ -30,4 +30,63 @@ std::vector <int> MakeIntVector(const std::vector<cld>&);
 
 std::vector <int> ReadVector();
 
+// Header-only part, shared with Aho_Corasik.
+
+// the least power of two not below base
+inline size_t RoundUpToDegreeOfTwo( size_t base)
+{
+    size_t closestNumber = 1;
+    while ( closestNumber < base ) {
+        closestNumber *= 2;
+    }
+    return closestNumber;
+}
+
+// roots[k] = e^(2 pi i k / size) for k < size / 2, the twiddle factors of MakeIterativeFFT
+template <typename TFloat>
+std::vector <std::complex<TFloat>> MakeRootsOfUnity( size_t size)
+{
+    std::vector <std::complex<TFloat>> roots(size / 2);
+    for (size_t i = 0; i < size / 2; i++) {
+        roots[i] = std::polar(TFloat(1), TFloat(2 * M_PI) * i / size);
+    }
+    return roots;
+}
+
+// In place transform of a power of two size: the bit reversal permutation, then the butterflies
+// with the given roots, conjugated for the inverse one, which is also divided by the size.
+template <typename TFloat>
+void MakeIterativeFFT(std::vector <std::complex<TFloat>>& complexVector,
+                      const std::vector <std::complex<TFloat>>& roots, bool inverse)
+{
+    auto size = complexVector.size();
+    for (size_t i = 1, j = 0; i < size; i++) {
+        size_t bit = size >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(complexVector[i], complexVector[j]);
+        }
+    }
+    for (size_t length = 2; length <= size; length *= 2) {
+        size_t step = size / length;
+        for (size_t begin = 0; begin < size; begin += length) {
+            for (size_t i = 0; i < length / 2; i++) {
+                std::complex<TFloat> w = inverse ? std::conj(roots[i * step]) : roots[i * step];
+                std::complex<TFloat> u = complexVector[begin + i];
+                std::complex<TFloat> v = complexVector[begin + i + length / 2] * w;
+                complexVector[begin + i] = u + v;
+                complexVector[begin + i + length / 2] = u - v;
+            }
+        }
+    }
+    if (inverse) {
+        for (auto& element : complexVector) {
+            element /= static_cast<TFloat>(size);
+        }
+    }
+}
+
 #endif /* FFT_h */
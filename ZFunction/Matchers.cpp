@@ -0,0 +1,558 @@
+#include "Matchers.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+void CalculateZFunction(std::string_view sample, std::vector<int>& zFunction) {
+    int size = sample.size();
+    zFunction.assign(size, 0);
+    
+    // [leftBorder, rightBorder) is the rightmost segment found equal to a prefix
+    int leftBorder = 0, rightBorder = 0;
+    
+    for (int i = 1; i < size; ++i) {
+        if (i < rightBorder) {
+            zFunction[i] = std::min(zFunction[i - leftBorder], rightBorder - i);
+        }
+        while (i + zFunction[i] < size && sample[i + zFunction[i]] == sample[zFunction[i]]) {
+            ++zFunction[i];
+        }
+        if (i + zFunction[i] > rightBorder) {
+            leftBorder = i;
+            rightBorder = i + zFunction[i];
+        }
+    }
+}
+
+std::vector<int> CalculateZFunction(std::string_view sample) {
+    std::vector<int> zFunction;
+    CalculateZFunction(sample, zFunction);
+    return zFunction;
+}
+
+int GetByteFrequencyRank(unsigned char c) {
+    static const std::string_view lowerOrder = "zqxjkvbpygfwmucldrhsnioate";
+    static const std::string_view upperOrder = "ZQXJKVBPYGFWMUCLDRHSNIOATE";
+    if (c == ' ') {
+        return 100;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return 70 + lowerOrder.find(c);
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 40 + upperOrder.find(c);
+    }
+    if ((c >= '0' && c <= '9') || c == '.' || c == ',' || c == '\n') {
+        return 30;
+    }
+    return c < 128 ? 10 : 0;
+}
+
+CStreamingZMatcher::CStreamingZMatcher(std::string_view sample) {
+    Reset(sample);
+}
+
+void CStreamingZMatcher::Reset(std::string_view sample) {
+    this->sample.assign(sample.begin(), sample.end());
+    CalculateZFunction(this->sample, zFunction);
+    position = 0;
+    candidate = 0;
+}
+
+void CStreamingZMatcher::SkipCandidate() {
+    // the text in [candidate, position) is known, so is how far each next start matches
+    size_t next = candidate + 1;
+    while (next < position && static_cast<size_t>(zFunction[next - candidate]) < position - next) {
+        ++next;
+    }
+    candidate = next;
+}
+
+void CStreamingZMatcher::Feed(std::string_view chunk, const TMatchCallback& onMatch) {
+    if (sample.empty()) {
+        return;
+    }
+    for (auto c : chunk) {
+        while (true) {
+            if (sample[position - candidate] == c) {
+                ++position;
+                if (position - candidate == sample.size()) {
+                    onMatch(candidate);
+                    SkipCandidate();
+                }
+                break;
+            }
+            if (candidate == position) {
+                ++position;
+                candidate = position;
+                break;
+            }
+            SkipCandidate();
+        }
+    }
+}
+
+void CStreamingZMatcher::Find(std::string_view text, const TMatchCallback& onMatch) {
+    position = 0;
+    candidate = 0;
+    Feed(text, onMatch);
+}
+
+const char* CStreamingZMatcher::GetName() const {
+    return "z";
+}
+
+void CalculatePrefixFunction(std::string_view sample, std::vector<int>& prefixFunction) {
+    int size = sample.size();
+    prefixFunction.assign(size, 0);
+    for (int i = 1; i < size; ++i) {
+        int border = prefixFunction[i - 1];
+        while (border > 0 && sample[i] != sample[border]) {
+            border = prefixFunction[border - 1];
+        }
+        prefixFunction[i] = sample[i] == sample[border] ? border + 1 : 0;
+    }
+}
+
+CKMPMatcher::CKMPMatcher(std::string_view sample) {
+    Reset(sample);
+}
+
+void CKMPMatcher::Reset(std::string_view sample) {
+    this->sample.assign(sample.begin(), sample.end());
+    CalculatePrefixFunction(this->sample, prefixFunction);
+    position = 0;
+    matched = 0;
+}
+
+void CKMPMatcher::Feed(std::string_view chunk, const TMatchCallback& onMatch) {
+    auto sampleSize = sample.size();
+    if (sampleSize == 0) {
+        return;
+    }
+    for (auto c : chunk) {
+        while (matched > 0 && (matched == sampleSize || sample[matched] != c)) {
+            matched = prefixFunction[matched - 1];
+        }
+        if (sample[matched] == c) {
+            ++matched;
+        }
+        ++position;
+        if (matched == sampleSize) {
+            onMatch(position - sampleSize);
+        }
+    }
+}
+
+void CKMPMatcher::Find(std::string_view text, const TMatchCallback& onMatch) {
+    position = 0;
+    matched = 0;
+    Feed(text, onMatch);
+}
+
+const char* CKMPMatcher::GetName() const {
+    return "kmp";
+}
+
+// Maximal suffix of sample for the order given by isGreater and its period.
+template <typename TCompare>
+long long FindMaximalSuffix(std::string_view sample, TCompare isGreater, long long& period) {
+    long long size = sample.size();
+    long long suffix = -1;
+    long long j = 0;
+    long long k = 1;
+    period = 1;
+    while (j + k < size) {
+        unsigned char current = sample[j + k];
+        unsigned char best = sample[suffix + k];
+        if (isGreater(best, current)) {
+            j += k;
+            k = 1;
+            period = j - suffix;
+        } else if (current == best) {
+            if (k != period) {
+                ++k;
+            } else {
+                j += period;
+                k = 1;
+            }
+        } else {
+            suffix = j;
+            j = suffix + 1;
+            k = 1;
+            period = 1;
+        }
+    }
+    return suffix;
+}
+
+CTwoWayMatcher::CTwoWayMatcher(std::string_view sample) : sample(sample) {
+    // the critical factorization is the later of the two maximal suffixes for opposite orders
+    long long lessPeriod;
+    long long greaterPeriod;
+    long long lessSuffix = FindMaximalSuffix(sample, std::greater<unsigned char>(), lessPeriod);
+    long long greaterSuffix = FindMaximalSuffix(sample, std::less<unsigned char>(), greaterPeriod);
+    if (lessSuffix > greaterSuffix) {
+        criticalPosition = lessSuffix;
+        period = lessPeriod;
+    } else {
+        criticalPosition = greaterSuffix;
+        period = greaterPeriod;
+    }
+    long long size = sample.size();
+    isPeriodic = criticalPosition + 1 + period <= size &&
+                 std::memcmp(sample.data(), sample.data() + period, criticalPosition + 1) == 0;
+    if (!isPeriodic) {
+        // any shift not exceeding the longer part is safe
+        period = std::max(criticalPosition + 1, size - criticalPosition - 1) + 1;
+    }
+}
+
+void CTwoWayMatcher::Find(std::string_view text, const TMatchCallback& onMatch) {
+    long long size = sample.size();
+    long long textSize = text.size();
+    if (size == 0) {
+        return;
+    }
+    // the sample prefix known to match after a periodic shift, -1 if none
+    long long memory = -1;
+    for (long long start = 0; start <= textSize - size;) {
+        // the right part is compared left to right, then the left part right to left
+        long long i = std::max(criticalPosition, memory) + 1;
+        while (i < size && sample[i] == text[start + i]) {
+            ++i;
+        }
+        if (i < size) {
+            start += i - criticalPosition;
+            memory = -1;
+            continue;
+        }
+        i = criticalPosition;
+        long long lowest = isPeriodic ? memory : -1;
+        while (i > lowest && sample[i] == text[start + i]) {
+            --i;
+        }
+        if (i <= lowest) {
+            onMatch(start);
+        }
+        start += period;
+        if (isPeriodic) {
+            memory = size - period - 1;
+        }
+    }
+}
+
+const char* CTwoWayMatcher::GetName() const {
+    return "two-way";
+}
+
+CAnchorMatcher::CAnchorMatcher(std::string_view sample) : sample(sample), rareOffset(0), secondOffset(0),
+                                                          fallback(sample) {
+    auto rank = [&sample](size_t i) {
+        return GetByteFrequencyRank(sample[i]);
+    };
+    for (size_t i = 1; i < sample.size(); ++i) {
+        if (rank(i) < rank(rareOffset)) {
+            rareOffset = i;
+        }
+    }
+    secondOffset = rareOffset == 0 && sample.size() > 1 ? 1 : 0;
+    for (size_t i = 0; i < sample.size(); ++i) {
+        if (i != rareOffset && sample[i] != sample[rareOffset] && rank(i) < rank(secondOffset)) {
+            secondOffset = i;
+        }
+    }
+}
+
+void CAnchorMatcher::Find(std::string_view text, const TMatchCallback& onMatch) {
+    auto sampleSize = sample.size();
+    auto textSize = text.size();
+    if (sampleSize == 0 || textSize < sampleSize) {
+        return;
+    }
+    char rare = sample[rareOffset];
+    char second = sample[secondOffset];
+    // anchors are given up when the candidates or the verified bytes outgrow the scanned text
+    size_t candidates = 0;
+    size_t verifiedBytes = 0;
+    size_t start = 0;
+    while (start + sampleSize <= textSize) {
+        const char* from = text.data() + start + rareOffset;
+        const void* found = std::memchr(from, rare, textSize - sampleSize + 1 - start);
+        if (found == NULL) {
+            return;
+        }
+        start = static_cast<const char*>(found) - text.data() - rareOffset;
+        ++candidates;
+        if (text[start + secondOffset] == second) {
+            verifiedBytes += sampleSize;
+            if (std::memcmp(text.data() + start, sample.data(), sampleSize) == 0) {
+                onMatch(start);
+            }
+        }
+        ++start;
+        if (candidates > 256 + start / 8 || verifiedBytes > 4096 + 2 * start) {
+            fallback.Reset(sample);
+            fallback.Feed(text.substr(start), [&onMatch, start](size_t position) {
+                onMatch(start + position);
+            });
+            return;
+        }
+    }
+}
+
+const char* CAnchorMatcher::GetName() const {
+    return "anchor";
+}
+
+std::unique_ptr<CMatcher> CreateMatcher(EMatcherEngine engine, std::string_view sample) {
+    switch (engine) {
+        case EMatcherEngine::Z:
+            return std::unique_ptr<CMatcher>(new CStreamingZMatcher(sample));
+        case EMatcherEngine::KMP:
+            return std::unique_ptr<CMatcher>(new CKMPMatcher(sample));
+        case EMatcherEngine::TwoWay:
+            return std::unique_ptr<CMatcher>(new CTwoWayMatcher(sample));
+        case EMatcherEngine::Anchor:
+            return std::unique_ptr<CMatcher>(new CAnchorMatcher(sample));
+    }
+    return nullptr;
+}
+
+EMatcherEngine ChooseMatcher(std::string_view sample) {
+    // samples over a few letters (DNA, binary) come with texts over the same letters, where any
+    // anchor byte is frequent; Two-Way was the fastest on them for every sample length measured
+    std::vector<bool> isPresent(256, false);
+    size_t alphabetSize = 0;
+    for (auto c : sample) {
+        if (!isPresent[static_cast<unsigned char>(c)]) {
+            isPresent[static_cast<unsigned char>(c)] = true;
+            ++alphabetSize;
+        }
+    }
+    return alphabetSize <= 4 ? EMatcherEngine::TwoWay : EMatcherEngine::Anchor;
+}
+
+std::vector<int> FindEachSampleOccurrence(EMatcherEngine engine, const std::string& sample, const std::string& text) {
+    std::vector<int> occurrences;
+    CreateMatcher(engine, sample)->Find(text, [&occurrences](size_t position) {
+        occurrences.push_back(position);
+    });
+    return occurrences;
+}
+
+std::vector<int> FindEachSampleOccurrence(const std::string& sample, const std::string& text) {
+    return FindEachSampleOccurrence(EMatcherEngine::Z, sample, text);
+}
+
+// Searches the chunks given by nextChunk on threadsCount workers that live for the whole search.
+// nextChunk(buffer, chunk) sets chunk to the next text chunk, possibly stored in buffer, and
+// returns false at the end; chunk k starts at k * chunkSize and overlaps the next one by p - 1
+// chars. At most 2 * threadsCount chunks are in flight, each with a bit per start for its
+// occurrences, and the calling thread reads the chunks and emits the occurrences in order.
+void FindEachSampleOccurrenceInChunks(EMatcherEngine engine, std::string_view sample, size_t chunkSize,
+                                      size_t threadsCount,
+                                      const std::function<bool(std::string&, std::string_view&)>& nextChunk,
+                                      const TMatchCallback& onMatch) {
+    struct SSlot {
+        std::string buffer;
+        std::string_view chunk;
+        std::vector<uint64_t> starts;
+        bool isDone = false;
+    };
+    std::vector<SSlot> slots(2 * threadsCount);
+    std::mutex mutex;
+    std::condition_variable chunkReady, chunkDone;
+    // chunks [0, published) are readable by the workers, [0, taken) are taken by them
+    size_t published = 0, taken = 0;
+    bool isEnd = false;
+    
+    auto work = [&]() {
+        std::unique_ptr<CMatcher> matcher = CreateMatcher(engine, sample);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            chunkReady.wait(lock, [&]() { return taken < published || isEnd; });
+            if (taken == published) {
+                return;
+            }
+            SSlot& slot = slots[taken++ % slots.size()];
+            lock.unlock();
+            slot.starts.assign((chunkSize + 63) / 64, 0);
+            matcher->Find(slot.chunk, [&slot](size_t position) {
+                slot.starts[position / 64] |= uint64_t(1) << (position % 64);
+            });
+            lock.lock();
+            slot.isDone = true;
+            chunkDone.notify_one();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threadsCount; ++i) {
+        workers.emplace_back(work);
+    }
+    
+    bool isRead = false;
+    for (size_t emitted = 0;;) {
+        size_t inFlight;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight = published - emitted;
+        }
+        if (!isRead && inFlight < slots.size()) {
+            // the slot is not visible to the workers until it is published
+            SSlot& slot = slots[(emitted + inFlight) % slots.size()];
+            isRead = !nextChunk(slot.buffer, slot.chunk);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (isRead) {
+                isEnd = true;
+                chunkReady.notify_all();
+            } else {
+                slot.isDone = false;
+                ++published;
+                chunkReady.notify_one();
+            }
+            continue;
+        }
+        if (inFlight == 0) {
+            break;
+        }
+        SSlot& slot = slots[emitted % slots.size()];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunkDone.wait(lock, [&slot]() { return slot.isDone; });
+        }
+        size_t offset = emitted * chunkSize;
+        for (size_t word = 0; word < slot.starts.size(); ++word) {
+            for (uint64_t bits = slot.starts[word]; bits != 0; bits &= bits - 1) {
+                onMatch(offset + word * 64 + __builtin_ctzll(bits));
+            }
+        }
+        ++emitted;
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void FindEachSampleOccurrence(EMatcherEngine engine, std::string_view sample, std::string_view text,
+                              size_t threadsCount, const TMatchCallback& onMatch) {
+    auto sampleSize = sample.size();
+    if (sampleSize == 0 || text.size() < sampleSize) {
+        return;
+    }
+    // occurrences starting in [begin, end) of a chunk are found by searching up to end + p - 1
+    const size_t chunkSize = std::max<size_t>(1 << 22, 16 * sampleSize);
+    size_t startsCount = text.size() - sampleSize + 1;
+    size_t chunksCount = (startsCount + chunkSize - 1) / chunkSize;
+    threadsCount = std::max<size_t>(1, std::min(threadsCount, chunksCount));
+    size_t begin = 0;
+    FindEachSampleOccurrenceInChunks(engine, sample, chunkSize, threadsCount,
+                                     [&](std::string&, std::string_view& chunk) {
+        if (begin >= startsCount) {
+            return false;
+        }
+        chunk = text.substr(begin, chunkSize + sampleSize - 1);
+        begin += chunkSize;
+        return true;
+    }, onMatch);
+}
+
+void FindEachSampleOccurrence(EMatcherEngine engine, std::string_view sample, const TTextReader& read,
+                              size_t threadsCount, const TMatchCallback& onMatch) {
+    auto sampleSize = sample.size();
+    if (sampleSize == 0) {
+        return;
+    }
+    const size_t chunkSize = std::max<size_t>(1 << 22, 16 * sampleSize);
+    threadsCount = std::max<size_t>(1, threadsCount);
+    // the last p - 1 chars read, they start the next chunk
+    std::string overlap;
+    bool isEnd = false;
+    FindEachSampleOccurrenceInChunks(engine, sample, chunkSize, threadsCount,
+                                     [&](std::string& buffer, std::string_view& chunk) {
+        buffer.resize(chunkSize + sampleSize - 1);
+        std::copy(overlap.begin(), overlap.end(), buffer.begin());
+        size_t size = overlap.size();
+        while (!isEnd && size < buffer.size()) {
+            size_t count = read(&buffer[size], buffer.size() - size);
+            isEnd = count == 0;
+            size += count;
+        }
+        if (size < sampleSize || size == overlap.size()) {
+            return false;
+        }
+        overlap.assign(buffer, size - (sampleSize - 1), sampleSize - 1);
+        chunk = std::string_view(buffer.data(), size);
+        return true;
+    }, onMatch);
+}
+
+CHashedText::CHashedText(std::string_view text, size_t threadsCount) : text(text), threadsCount(threadsCount),
+                                                                      tableLength(0) {
+}
+
+CHashedText::SWindowTable CHashedText::BuildWindowTable(size_t length) const {
+    size_t windowsCount = text.size() - length + 1;
+    SWindowTable table;
+    // about four windows per bucket
+    size_t bucketsCount = 1;
+    while (bucketsCount * 4 < windowsCount) {
+        bucketsCount *= 2;
+    }
+    table.bucketMask = bucketsCount - 1;
+    // counting sort of the positions by bucket, so they stay increasing within one
+    std::vector<uint32_t> buckets(windowsCount);
+    table.bucketBegins.assign(bucketsCount + 1, 0);
+    for (size_t start = 0; start < windowsCount; ++start) {
+        buckets[start] = hashes->GetHash(start, length) & table.bucketMask;
+        ++table.bucketBegins[buckets[start] + 1];
+    }
+    for (size_t bucket = 1; bucket <= bucketsCount; ++bucket) {
+        table.bucketBegins[bucket] += table.bucketBegins[bucket - 1];
+    }
+    std::vector<size_t> next(table.bucketBegins.begin(), table.bucketBegins.end() - 1);
+    table.positions.resize(windowsCount);
+    for (size_t start = 0; start < windowsCount; ++start) {
+        table.positions[next[buckets[start]]++] = start;
+    }
+    return table;
+}
+
+void CHashedText::FindEachSampleOccurrence(std::string_view sample, const TMatchCallback& onMatch) {
+    auto sampleSize = sample.size();
+    if (sampleSize == 0 || text.size() < sampleSize) {
+        return;
+    }
+    size_t& cost = lengthCosts[sampleSize];
+    if (cost < tableCost) {
+        EMatcherEngine engine = ChooseMatcher(sample);
+        cost += engine == EMatcherEngine::TwoWay ? twoWayCost : 1;
+        CreateMatcher(engine, sample)->Find(text, onMatch);
+        return;
+    }
+    if (!hashes) {
+        hashes.reset(new CRollingHash(text, false, threadsCount));
+    }
+    if (tableLength != sampleSize) {
+        if (tableLength != 0) {
+            lengthCosts[tableLength] = 0;
+        }
+        // the old table is freed before the new one is built
+        windowTable = SWindowTable();
+        windowTable = BuildWindowTable(sampleSize);
+        tableLength = sampleSize;
+    }
+    const SWindowTable& table = windowTable;
+    uint64_t sampleHash = hashes->Hash(sample);
+    size_t bucket = sampleHash & table.bucketMask;
+    for (size_t i = table.bucketBegins[bucket]; i < table.bucketBegins[bucket + 1]; ++i) {
+        size_t start = table.positions[i];
+        if (hashes->GetHash(start, sampleSize) == sampleHash &&
+            std::memcmp(text.data() + start, sample.data(), sampleSize) == 0) {
+            onMatch(start);
+        }
+    }
+}
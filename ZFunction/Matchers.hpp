@@ -0,0 +1,195 @@
+//
+//  Matchers.hpp
+//  ZFunction
+//
+//  Single pattern search engines behind one interface.
+//
+
+#ifndef Matchers_hpp
+#define Matchers_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "../RollingHash/RollingHash.hpp"
+
+// Writes the Z-function of sample into zFunction, reusing its capacity: repeated calls on
+// strings of similar size do not allocate. zFunction[0] is 0.
+void CalculateZFunction(std::string_view sample, std::vector<int>& zFunction);
+std::vector<int> CalculateZFunction(std::string_view sample);
+
+// prefixFunction[i] is the length of the longest proper border of sample[0 .. i]
+void CalculatePrefixFunction(std::string_view sample, std::vector<int>& prefixFunction);
+
+// Rough rank of how common a byte is in text, higher is more common: space, then lower case
+// letters in English order, upper case letters, digits and punctuation, the rest is rare.
+int GetByteFrequencyRank(unsigned char c);
+
+// called with the position of each occurrence, in increasing order
+using TMatchCallback = std::function<void(size_t)>;
+
+class CMatcher {
+public:
+    virtual ~CMatcher() = default;
+    
+    virtual void Find(std::string_view text, const TMatchCallback& onMatch) = 0;
+    virtual const char* GetName() const = 0;
+};
+
+// Finds the occurrences of a sample in a text given in chunks of any size, keeping only the
+// sample and its Z-function: O(p) memory whatever the text length, O(n + p) time.
+// At any moment the text since candidate start equals a prefix of the sample. On a mismatch
+// or a full match the next candidate is found from the Z-function of the sample, without
+// looking at the text again, so no text is buffered.
+class CStreamingZMatcher : public CMatcher {
+public:
+    explicit CStreamingZMatcher(std::string_view sample);
+    
+    // starts a new search for sample, reusing the memory of the previous one
+    void Reset(std::string_view sample);
+    // onMatch(position) is called with the text position of each occurrence ending in chunk
+    void Feed(std::string_view chunk, const TMatchCallback& onMatch);
+    
+    void Find(std::string_view text, const TMatchCallback& onMatch) override;
+    const char* GetName() const override;
+    
+private:
+    // moves candidate to the next text position that can still start an occurrence
+    void SkipCandidate();
+    
+    std::string sample;
+    std::vector<int> zFunction;
+    // number of chars read
+    size_t position;
+    // the text in [candidate, position) equals the prefix of the sample
+    size_t candidate;
+};
+
+// Knuth-Morris-Pratt over the prefix function, streaming like the Z matcher.
+class CKMPMatcher : public CMatcher {
+public:
+    explicit CKMPMatcher(std::string_view sample);
+    
+    void Reset(std::string_view sample);
+    void Feed(std::string_view chunk, const TMatchCallback& onMatch);
+    
+    void Find(std::string_view text, const TMatchCallback& onMatch) override;
+    const char* GetName() const override;
+    
+private:
+    std::string sample;
+    std::vector<int> prefixFunction;
+    size_t position;
+    // length of the longest prefix of the sample ending at position
+    size_t matched;
+};
+
+// Crochemore-Perrin Two-Way: O(n + p) time and O(1) memory besides the sample, shifts by
+// more than one char on mismatches, so long samples make it sublinear in practice.
+class CTwoWayMatcher : public CMatcher {
+public:
+    explicit CTwoWayMatcher(std::string_view sample);
+    
+    void Find(std::string_view text, const TMatchCallback& onMatch) override;
+    const char* GetName() const override;
+    
+private:
+    std::string sample;
+    // the sample is split into sample[0 .. criticalPosition] and the rest
+    long long criticalPosition;
+    long long period;
+    bool isPeriodic;
+};
+
+// Finds candidates by the rarest byte of the sample with memchr (vectorized in libc), filters
+// them by a second rare byte and verifies with memcmp. When candidates come too often for that
+// to pay off (small alphabets, adversarial data) the rest of the text goes through the Z matcher,
+// so the time stays O(n + p).
+class CAnchorMatcher : public CMatcher {
+public:
+    explicit CAnchorMatcher(std::string_view sample);
+    
+    void Find(std::string_view text, const TMatchCallback& onMatch) override;
+    const char* GetName() const override;
+    
+private:
+    std::string sample;
+    size_t rareOffset;
+    size_t secondOffset;
+    CStreamingZMatcher fallback;
+};
+
+enum class EMatcherEngine {
+    Z,
+    KMP,
+    TwoWay,
+    Anchor
+};
+
+const std::vector<EMatcherEngine> matcherEngines = {EMatcherEngine::Z, EMatcherEngine::KMP,
+                                                    EMatcherEngine::TwoWay, EMatcherEngine::Anchor};
+
+std::unique_ptr<CMatcher> CreateMatcher(EMatcherEngine engine, std::string_view sample);
+
+// Picks the engine expected to be fastest by the alphabet of the sample.
+EMatcherEngine ChooseMatcher(std::string_view sample);
+
+std::vector<int> FindEachSampleOccurrence(EMatcherEngine engine, const std::string& sample, const std::string& text);
+std::vector<int> FindEachSampleOccurrence(const std::string& sample, const std::string& text);
+
+// Writes up to size chars of a streamed text to buffer and returns how many, 0 at its end.
+using TTextReader = std::function<size_t(char* buffer, size_t size)>;
+
+// Splits text into chunks overlapping by p - 1 chars and searches them on threadsCount threads
+// kept for the whole search, with at most two chunks per thread in flight. onMatch gets the
+// occurrences in increasing order, as with a single thread.
+void FindEachSampleOccurrence(EMatcherEngine engine, std::string_view sample, std::string_view text,
+                              size_t threadsCount, const TMatchCallback& onMatch);
+// The same for a text given by read, of which only the chunks in flight are kept.
+void FindEachSampleOccurrence(EMatcherEngine engine, std::string_view sample, const TTextReader& read,
+                              size_t threadsCount, const TMatchCallback& onMatch);
+
+// Text searched for many samples. Samples go to the chosen matcher until the searches of one
+// length have cost as much as a table; then all windows of that length are hashed once into a
+// table bucketed by hash, and every further sample of the length costs O(p + occurrences) expected.
+// Hash matches are verified with memcmp, so the result is exact. The prefix hashes take 16
+// bytes per char and the table 10 more, they are built only when the first table is needed.
+// Only the table of the last such length is kept: building another one drops it, and its
+// length has to cost a table again before it gets one back.
+class CHashedText {
+public:
+    explicit CHashedText(std::string_view text, size_t threadsCount = 1);
+    
+    void FindEachSampleOccurrence(std::string_view sample, const TMatchCallback& onMatch);
+    
+private:
+    // start positions of the windows of one length, grouped by hash modulo the bucket count,
+    // increasing within a bucket
+    struct SWindowTable {
+        uint64_t bucketMask;
+        std::vector<size_t> bucketBegins;
+        std::vector<size_t> positions;
+    };
+    
+    // costs in anchored searches: on 16 MB a table took as long as 80 of them on English text
+    // and as 10 Two-Way searches on DNA, a Two-Way search as 8 anchored ones
+    static const size_t tableCost = 64;
+    static const size_t twoWayCost = 8;
+    
+    SWindowTable BuildWindowTable(size_t length) const;
+    
+    std::string_view text;
+    size_t threadsCount;
+    std::unique_ptr<CRollingHash> hashes;
+    // cost of the searches so far by sample length
+    std::unordered_map<size_t, size_t> lengthCosts;
+    // length of the windows in windowTable, 0 before the first table
+    size_t tableLength;
+    SWindowTable windowTable;
+};
+
+#endif /* Matchers_hpp */
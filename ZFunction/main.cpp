@@ -1,57 +1,129 @@
-#include <iostream>
-#include <vector>
-#include <string>
-
-const char SEPARATOR = '#';
+#include "Matchers.hpp"
 
-const std::vector<int>& CalculateZFunction(const std::string& sample) {
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <algorithm>
 
-    auto size = sample.size();
-    std::vector<int> zFunction(size);
-    
-    int leftBorder = 0, rightBorder = 0;
-    
-    for (auto i = 1; i < size; ++i) {
-        if (i < rightBorder) {
-            zFunction[i] = std::min(zFunction[i - leftBorder], rightBorder - i);
-        }
-            while (sample[i + zFunction[i]] == sample[zFunction[i]]) {
-                ++zFunction[i];
-            }
-            if (i + zFunction[i] > rightBorder) {
-                leftBorder = i;
-                leftBorder = i + zFunction[i];
+// Compares the engines on synthetic English text, DNA and a binary text, by sample length.
+int RunBenchmark() {
+    std::mt19937 random(2020);
+    const size_t textSize = 1 << 25;
+    const std::vector<std::string> words = {"the", "of", "and", "to", "in", "is", "was", "that", "for", "it",
+                                            "with", "as", "his", "on", "be", "at", "by", "had", "this", "from",
+                                            "function", "string", "pattern", "search", "quickly", "Moscow",
+                                            "physics", "technology", "algorithm", "linear", "memory", "zebra"};
+    std::string english;
+    while (english.size() < textSize) {
+        english += words[random() % words.size()];
+        english += random() % 12 == 0 ? ". " : " ";
+    }
+    std::string dna(textSize, 'A');
+    for (auto& c : dna) {
+        c = "ACGT"[random() % 4];
+    }
+    std::string binary(textSize, 'a');
+    for (auto& c : binary) {
+        c = random() % 16 == 0 ? 'b' : 'a';
+    }
+    struct SCase {
+        const char* name;
+        const std::string* text;
+        std::string sample;
+    };
+    std::vector<SCase> cases = {{"english", &english, "the"}, {"english", &english, "linear memory"},
+                                {"english", &english, "Moscow physics"},
+                                {"english", &english, english.substr(1000, 200)},
+                                {"dna", &dna, "ACG"}, {"dna", &dna, "GATTACAGATTACA"},
+                                {"dna", &dna, dna.substr(1000, 64)}, {"dna", &dna, dna.substr(5000, 1000)},
+                                {"binary", &binary, "aaaaaaaaaaaaaaaaaaab"}, {"binary", &binary, binary.substr(100, 300)}};
+    for (const auto& current : cases) {
+        std::cerr << current.name << ", sample of " << current.sample.size() << " chars, chosen "
+                  << CreateMatcher(ChooseMatcher(current.sample), current.sample)->GetName() << ":";
+        std::vector<int> expected;
+        for (auto engine : matcherEngines) {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<int> occurrences = FindEachSampleOccurrence(engine, current.sample, *current.text);
+            double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << " " << CreateMatcher(engine, current.sample)->GetName() << " " << time << " s";
+            if (engine == matcherEngines.front()) {
+                expected = occurrences;
+            } else if (occurrences != expected) {
+                std::cerr << std::endl << "occurrences differ" << std::endl;
+                return 1;
             }
+        }
+        std::cerr << std::endl;
     }
-    
-    return zFunction;
+    return 0;
 }
 
-std::vector<int> FindEachSampleOccurrence(const std::string& sample, const std::string& text) {
-    std::string textWithSample = sample + SEPARATOR + text;
-    auto size = textWithSample.size();
-    
-    std::vector<int> zFunction = CalculateZFunction(textWithSample);
-    
-    std::vector<int> occurrences;
-    auto sampleSize = sample.size();
+// Usage:
+//   main                  reads the sample and the text lines and prints the occurrences
+//   main --benchmark      compares the engines on synthetic texts, timings go to stderr
+//   main --threads <n>    searches the text with the chosen engine on n threads, in chunks of
+//                         a few MB read as the threads go
+//   main --batch          reads the text line, then one sample per line, and prints the occurrences
+//                         of each sample on its own line; once the searches of one length have cost
+//                         as much as hashing all text windows of that length, by a table of them,
+//                         kept for the last such length only
+//
+// Except for --batch, the text is read in chunks and occurrences are printed as soon as
+// they are found, so the memory does not depend on the text length.
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "--benchmark") {
+        return RunBenchmark();
+    }
     
-    for (auto i = 0; i < size; ++i) {
-        if (zFunction[i] == sampleSize) {
-            occurrences.push_back(i - sampleSize - 1);
+    if (mode == "--batch") {
+        std::string text;
+        std::getline(std::cin, text);
+        CHashedText hashedText(text);
+        std::string sample;
+        while (std::getline(std::cin, sample)) {
+            hashedText.FindEachSampleOccurrence(sample, [](size_t position) {
+                std::cout << position << " ";
+            });
+            std::cout << '\n';
         }
+        return 0;
     }
     
-    return occurrences;
-}
-
-int main() {
     std::string sample;
     std::getline(std::cin, sample);
-    std::string text;
-    std::getline(std::cin, text);
-    for (const auto& element : FindEachSampleOccurrence(sample, text)) {
-        std::cout << element << " ";
+    
+    if (mode == "--threads" && argc > 2) {
+        bool isLineEnd = false;
+        auto readLine = [&isLineEnd](char* buffer, size_t size) -> size_t {
+            if (isLineEnd) {
+                return 0;
+            }
+            size_t count = std::cin.read(buffer, size).gcount();
+            auto lineEnd = std::find(buffer, buffer + count, '\n');
+            isLineEnd = lineEnd != buffer + count;
+            return lineEnd - buffer;
+        };
+        FindEachSampleOccurrence(ChooseMatcher(sample), sample, readLine, std::stoul(argv[2]), [](size_t position) {
+            std::cout << position << " ";
+        });
+        std::cout << std::endl;
+        return 0;
+    }
+    
+    CStreamingZMatcher matcher(sample);
+    std::vector<char> chunk(1 << 16);
+    bool isLineEnd = false;
+    while (!isLineEnd && std::cin.read(chunk.data(), chunk.size()).gcount() > 0) {
+        std::string_view read(chunk.data(), std::cin.gcount());
+        auto lineEnd = read.find('\n');
+        if (lineEnd != std::string_view::npos) {
+            read = read.substr(0, lineEnd);
+            isLineEnd = true;
+        }
+        matcher.Feed(read, [](size_t position) {
+            std::cout << position << " ";
+        });
     }
     std::cout << std::endl;
     return 0;